@@ -0,0 +1,90 @@
+/*
+Usage example:
+
+// Lib C includes
+#include <stdint.h>
+#include <stdbool.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+
+// User C++ class headers
+#include "BootTracer.h"
+
+// Record a milestone, only its first occurrence after boot is kept so it can be called on every pass
+BootTracer::getInstance().mark(BootMilestone::GOT_IP);
+
+// Cycles since the kernel started, 0 when the milestone hasn't been reached yet
+uint64_t cycles = BootTracer::getInstance().getCycles(BootMilestone::GOT_IP);
+printk("%s after %lld us\r\n", BootTracer::getName(BootMilestone::GOT_IP), k_cyc_to_us_floor64(cycles));
+
+// With CONFIG_BOOT_TRACER_HISTORY, the milestones of the last boots are kept in NVS, newest first
+boot_record_t records[CONFIG_BOOT_TRACER_HISTORY_SIZE];
+int count = BootTracer::getInstance().getHistory(records, ARRAY_SIZE(records));
+
+The 'boot trace' shell command dumps the current boot and 'boot history' the persisted ones. Time
+spent in MCUboot, including the swap after an update, happens before the kernel clock starts and is
+not included.
+*/
+
+#ifndef BOOT_TRACER_H
+#define BOOT_TRACER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+enum class BootMilestone : uint8_t {
+  KERNEL_READY,
+  MAIN_STARTED,
+  NETWORK_STARTED,
+  GOT_IP,
+  IMAGE_CONFIRMED,
+  UPDATER_READY,
+  FIRST_HTTP_REQUEST,
+  FIRST_HTTP_RESPONSE,
+  COUNT
+};
+
+static constexpr size_t BOOT_MILESTONE_COUNT = (size_t)BootMilestone::COUNT;
+static constexpr uint32_t BOOT_MILESTONE_NOT_REACHED = UINT32_MAX;
+
+// Persisted record of a boot
+typedef struct {
+  uint32_t bootNumber;
+  // Microseconds since the kernel started, BOOT_MILESTONE_NOT_REACHED for the ones never reached
+  uint32_t milestoneUs[BOOT_MILESTONE_COUNT];
+} boot_record_t;
+
+class BootTracer {
+public:
+  // Static method to access the singleton instance
+  static BootTracer& getInstance();
+
+  void mark(BootMilestone milestone);
+  uint64_t getCycles(BootMilestone milestone);
+  static const char *getName(BootMilestone milestone);
+#ifdef CONFIG_BOOT_TRACER_HISTORY
+  int getHistory(boot_record_t *records, size_t count);
+
+  // Not meant to be called directly, used by the work item saving the current boot
+  void persist();
+#endif // CONFIG_BOOT_TRACER_HISTORY
+
+private:
+  // Private constructor to prevent direct instantiation
+  BootTracer();
+  ~BootTracer();
+
+  static uint64_t now();
+
+  // Static member to hold the singleton instance
+  static BootTracer instance;
+  uint64_t timestamps[BOOT_MILESTONE_COUNT];
+#ifdef CONFIG_BOOT_TRACER_HISTORY
+  bool persisted;
+#endif // CONFIG_BOOT_TRACER_HISTORY
+};
+
+#endif // BOOT_TRACER_H
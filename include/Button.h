@@ -26,19 +26,52 @@ while (true) {
   }
   k_msleep(200);
 }
+
+// Or let the button publish EVENT_BUTTON_PRESSED, EVENT_BUTTON_RELEASED, EVENT_BUTTON_LONG_PRESSED
+// and EVENT_BUTTON_DOUBLE_CLICKED on buttonChannel from its GPIO interrupt. The object must
+// outlive the interrupt mode, hence static here.
+static Button button(&buttonGpio);
+button.enableEvents();
 */
 
 #ifndef BUTTON_H
 #define BUTTON_H
 
+#include <stdint.h>
 #include <stdbool.h>
+#include <zephyr/kernel.h>
 #include <zephyr/drivers/gpio.h>
 
+#include "EventManager.h"
+
 enum class ButtonPolarity {
   NORMAL,
   INVERTED
 };
 
+class Button;
+
+// Kernel objects used in interrupt mode, kept together so handlers can get back to their button
+typedef struct {
+  struct gpio_callback callback;
+  struct k_work_delayable debounceWork;
+  struct k_work_delayable longPressWork;
+  Button *button;
+} button_context_t;
+
+// Statistics of all the buttons in interrupt mode
+typedef struct {
+  uint32_t interrupts;
+  uint32_t wakeups;
+  uint32_t events;
+  // Events dropped because their channel was busy
+  uint32_t failed;
+  uint32_t presses;
+  uint32_t lastLatencyUs;
+  uint32_t maxLatencyUs;
+  uint64_t totalLatencyUs;
+} button_stats_t;
+
 class Button {
 
 public:
@@ -46,9 +79,28 @@ public:
   ~Button();
 
   bool isPressed(ButtonPolarity polarity = ButtonPolarity::NORMAL);
+  int enableEvents(ButtonPolarity polarity = ButtonPolarity::NORMAL);
+  static void getStats(button_stats_t *stats);
+
+  // Interrupt and work handlers, not meant to be called directly
+  void onEdge();
+  void debounce();
+  void longPress();
 
 private:
   const struct gpio_dt_spec *gpio;
+  ButtonPolarity polarity;
+  bool eventsEnabled;
+  bool stateIsPressed;
+  bool edgePending;
+  bool longPressReported;
+  bool clickPending;
+  bool doubleClickReported;
+  uint32_t edgeCycles;
+  int64_t releaseTime;
+  button_context_t context;
+
+  void publish(event_id_t id, uint32_t latencyUs);
 
 };
 
@@ -0,0 +1,125 @@
+/*
+Usage example:
+
+// Lib C includes
+#include <stdint.h>
+#include <stdbool.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/dfu/flash_img.h>
+#include <zephyr/storage/flash_map.h>
+
+// User C++ class headers
+#include "DeltaPatcher.h"
+
+static struct flash_img_context flashContext;
+DeltaPatcher patcher(FIXED_PARTITION_ID(slot0_partition));
+
+// The new image is rebuilt from the running one in slot0 and the patch, and handed to the writer in
+// order. The header of the patch is checked against slot0 before anything is written
+flash_img_init(&flashContext);
+patcher.start([](const uint8_t *data, size_t length, bool flush) {
+  return flash_img_buffered_write(&flashContext, data, length, flush);
+});
+
+// Feed the patch as it is received, in fragments of any size
+patcher.write(fragment, fragmentLength);
+
+// Flush the writer and compare the SHA-256 of the rebuilt image with the one of the patch header
+if (patcher.finish() == 0) {
+  boot_request_upgrade(BOOT_UPGRADE_TEST);
+}
+
+Patch format, generated by scripts/delta.py:
+
+  header: magic "ZDP1", source size and target size as little-endian 32 bits integers, SHA-256 of
+          the source, SHA-256 of the target
+  then operations until the target is complete, each one starts with a LEB128 varint holding the
+  operation in its 2 low bits and its argument above them:
+    COPY   n        n source bytes from the source offset, which moves forward by n
+    ADD    n, data  n source bytes each added to a data byte, the source offset moves forward by n
+    INSERT n, data  n data bytes as is
+    SEEK   s        moves the source offset by s, zigzag encoded
+*/
+
+#ifndef DELTA_PATCHER_H
+#define DELTA_PATCHER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <zephyr/storage/flash_map.h>
+#include <mbedtls/sha256.h>
+
+#include "InplaceFunction.h"
+
+static constexpr uint32_t DELTA_PATCH_MAGIC = 0x3150445A;
+static constexpr size_t DELTA_PATCH_HASH_SIZE = 32;
+static constexpr size_t DELTA_PATCH_HEADER_SIZE = 12 + (2 * DELTA_PATCH_HASH_SIZE);
+// Longest LEB128 encoding of an operation
+static constexpr uint32_t DELTA_PATCH_VARINT_MAX_SHIFT = 63;
+// Source bytes read from flash at once
+static constexpr size_t DELTA_PATCHER_READ_SIZE = 256;
+
+enum class DeltaPatcherState {
+  HEADER,
+  OPERATION,
+  ADD,
+  INSERT,
+  DONE,
+  FAILED
+};
+
+enum class DeltaPatchOperation {
+  COPY = 0,
+  ADD = 1,
+  INSERT = 2,
+  SEEK = 3
+};
+
+class DeltaPatcher {
+
+public:
+  DeltaPatcher(uint8_t sourcePartitionId);
+  ~DeltaPatcher();
+
+  int start(InplaceFunction<int(const uint8_t *, size_t, bool)> writer);
+  int write(const uint8_t *data, size_t length);
+  int finish();
+
+  // Known once the header has been received
+  uint32_t sourceSize;
+  uint32_t targetSize;
+  uint32_t bytesWritten;
+
+private:
+  uint8_t sourcePartitionId;
+  const struct flash_area *sourceArea;
+  InplaceFunction<int(const uint8_t *, size_t, bool)> writer;
+  DeltaPatcherState state;
+  // The header and the operations can be split across fragments, they are gathered here
+  uint8_t header[DELTA_PATCH_HEADER_SIZE];
+  size_t headerLength;
+  uint64_t operation;
+  uint32_t operationShift;
+  uint8_t sourceHash[DELTA_PATCH_HASH_SIZE];
+  uint8_t targetHash[DELTA_PATCH_HASH_SIZE];
+  // Data bytes left in the current ADD or INSERT operation
+  uint32_t dataLeft;
+  uint32_t sourceOffset;
+  uint8_t buffer[DELTA_PATCHER_READ_SIZE];
+  mbedtls_sha256_context targetContext;
+
+  int parseHeader();
+  int parseOperation();
+  int copy(uint32_t length);
+  int add(const uint8_t *data, size_t length);
+  int emit(const uint8_t *data, size_t length);
+  void endOperation();
+  int checkSource();
+
+};
+
+#endif // DELTA_PATCHER_H
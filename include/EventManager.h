@@ -1,11 +1,20 @@
 #ifndef EVENT_MANAGER_H
 #define EVENT_MANAGER_H
 
+// Lib C
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+
 // Zephyr includes
 #include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/slist.h>
+#include <zephyr/sys/util.h>
 #include <zephyr/zbus/zbus.h>
 
-#define EVENT_ACTION_LIST_SIZE(list) (sizeof(list) / sizeof(list[0]))
+// Publishers running in a thread wait at most this long for a busy channel
+#define EVENT_PUBLISH_TIMEOUT K_MSEC(100)
 
 // Possible events
 typedef enum {
@@ -13,26 +22,257 @@ typedef enum {
   EVENT_OTA_UPDATE_SHELL_CMD,
   EVENT_NETWORK_AVAILABLE,
   EVENT_BUTTON_PRESSED,
+  EVENT_OTA_BENCHMARK_SHELL_CMD,
+  EVENT_BUTTON_RELEASED,
+  EVENT_BUTTON_LONG_PRESSED,
+  EVENT_BUTTON_DOUBLE_CLICKED,
+  EVENT_OTA_VERIFY_SHELL_CMD,
+  EVENT_NETWORK_UNAVAILABLE,
   EVENT_MAX_VALUE
 } event_id_t;
 
-// event_id_t enum is embedded inside event_t struct because ZBUS only accepts struct or union
+static constexpr size_t EVENT_IP_ADDRESS_MAX_LENGTH = 16;
+static constexpr size_t EVENT_URL_MAX_LENGTH = 128;
+
+// event_id_t enum is embedded inside event_t struct because ZBUS only accepts struct or union.
+// Every event payload starts with its id, so any of them can be read as an event_t.
 typedef struct {
   event_id_t id;
 } event_t;
 
-typedef void (*event_action_t) (void);
+// Published on networkChannel
+typedef struct {
+  event_id_t id;
+  char ipAddress[EVENT_IP_ADDRESS_MAX_LENGTH];
+} network_event_t;
+
+// Published on buttonChannel
+typedef struct {
+  event_id_t id;
+  uint32_t latencyUs;
+} button_event_t;
+
+// Published on otaChannel, an empty url selects the default image
+typedef struct {
+  event_id_t id;
+  char url[EVENT_URL_MAX_LENGTH];
+} ota_event_t;
+
+// Large enough for the payload of any channel, events are received into it
+typedef union {
+  event_t event;
+  network_event_t network;
+  button_event_t button;
+  ota_event_t ota;
+} event_message_t;
+
+typedef void (*event_action_t) (const event_message_t *message);
 
 typedef struct {
   event_id_t id;
   event_action_t action;
 } event_action_pair_t;
 
-void processEvent(event_t *event, const event_action_pair_t *eventActionList, uint8_t listLength);
-int waitForEvent(const zbus_observer *subscriber, event_t *event, k_timeout_t timeout);
-int publishEvent(event_t *event, k_timeout_t timeout);
+// Never defined on purpose: reaching it while building a dispatch table fails the compilation
+void eventDispatchTableError(const char *reason);
+
+// Actions grouped by event id, built at compile time from an event/action list so that
+// dispatching an event only runs the actions registered for it. An event can have several
+// actions, which run in list order. Unknown ids, missing actions and duplicate pairs are
+// compile errors.
+template <size_t N, size_t IdCount = EVENT_MAX_VALUE>
+class EventDispatchTable {
+
+public:
+  template <typename Pair>
+  consteval EventDispatchTable(const Pair (&list)[N]) : actions{}, first{} {
+    size_t index = 0;
+    size_t other = 0;
+    size_t id = 0;
+    uint16_t next[IdCount] = {};
+
+    for (index = 0; index < N; index++) {
+      if (((size_t)list[index].id == 0) || ((size_t)list[index].id >= IdCount)) {
+        eventDispatchTableError("Unknown event id");
+      }
+      if (list[index].action == nullptr) {
+        eventDispatchTableError("Event without action");
+      }
+      for (other = 0; other < index; other++) {
+        if ((list[other].id == list[index].id) && (list[other].action == list[index].action)) {
+          eventDispatchTableError("Duplicate event/action pair");
+        }
+      }
+      this->first[(size_t)list[index].id + 1]++;
+    }
+
+    // Actions of an event id are stored in actions[first[id]] up to actions[first[id + 1]]
+    for (id = 0; id < IdCount; id++) {
+      this->first[id + 1] += this->first[id];
+      next[id] = this->first[id];
+    }
+    for (index = 0; index < N; index++) {
+      this->actions[next[(size_t)list[index].id]++] = list[index].action;
+    }
+  }
+
+  void dispatch(uint32_t id, const event_message_t *message) const {
+    uint16_t index = 0;
+
+    if (id >= IdCount) {
+      return;
+    }
+
+    for (index = this->first[id]; index < this->first[id + 1]; index++) {
+      this->actions[index](message);
+    }
+  }
+
+private:
+  static_assert(N > 0, "Empty event/action list");
+  static_assert(N < UINT16_MAX, "Too many event/action pairs");
+
+  event_action_t actions[N];
+  uint16_t first[IdCount + 1];
+};
+
+// Import channels and make them exportable by just including "EventManager.h"
+ZBUS_CHAN_DECLARE(networkChannel, buttonChannel, otaChannel);
+
+// Channel carrying each payload type
+template <typename T>
+struct EventChannel;
+
+template <>
+struct EventChannel<network_event_t> {
+  static const struct zbus_channel *get() { return &networkChannel; }
+};
+
+template <>
+struct EventChannel<button_event_t> {
+  static const struct zbus_channel *get() { return &buttonChannel; }
+};
+
+template <>
+struct EventChannel<ota_event_t> {
+  static const struct zbus_channel *get() { return &otaChannel; }
+};
+
+typedef struct {
+  uint32_t published;
+  uint32_t failed;
+  uint32_t wakeups;
+} event_stats_t;
+
+typedef struct {
+  uint32_t published;
+  uint32_t failed;
+} event_channel_stats_t;
+
+// Ring cell, sequence tells whether the cell is free or holds the event of a given position
+typedef struct {
+  atomic_t sequence;
+  uint32_t timestamp;
+  event_message_t message;
+} event_queue_cell_t;
+
+typedef struct {
+  const char *name;
+  uint32_t size;
+  uint32_t pending;
+  uint32_t highWater;
+  uint32_t drops;
+  uint32_t received;
+  uint32_t maxLatencyUs;
+  uint32_t averageLatencyUs;
+} event_queue_stats_t;
+
+// Bounded multi-producer single-consumer ring of full event copies. It's fed by a zbus listener
+// so every published event is kept, unlike a subscriber that only gets notified and then reads
+// the latest value of the channel. Producers never block, an event is dropped and counted when
+// the ring is full.
+class EventQueue {
+
+public:
+  EventQueue(const char *name, event_queue_cell_t *cells, uint32_t size);
+  ~EventQueue();
+
+  bool push(const struct zbus_channel *channel);
+  int pop(event_message_t *message, k_timeout_t timeout);
+  void getStats(event_queue_stats_t *stats);
+
+  // All the queues, for the shell
+  static sys_slist_t queues;
+  sys_snode_t node;
+
+private:
+  const char *name;
+  event_queue_cell_t *cells;
+  uint32_t size;
+  atomic_t head;
+  atomic_t tail;
+  atomic_t highWater;
+  atomic_t drops;
+  struct k_sem available;
+  // Only updated by the consumer
+  uint32_t received;
+  uint32_t maxLatencyUs;
+  uint64_t totalLatencyUs;
+};
+
+// Define an event queue and the listener feeding it, attach the listener to channels with
+// ZBUS_CHAN_ADD_OBS(channel, name##Listener, priority)
+#define EVENT_QUEUE_DEFINE(_name, _size)                                                  \
+  BUILD_ASSERT(IS_POWER_OF_TWO(_size), "Event queue size must be a power of two");        \
+  static event_queue_cell_t _name##Cells[_size];                                          \
+  static EventQueue _name(STRINGIFY(_name), _name##Cells, _size);                         \
+  static void _name##ListenerCallback(const struct zbus_channel *channel) {               \
+    _name.push(channel);                                                                  \
+  }                                                                                       \
+  ZBUS_LISTENER_DEFINE(_name##Listener, _name##ListenerCallback)
+
+int publishOnChannel(const struct zbus_channel *channel, const void *message, k_timeout_t timeout);
+const void *readOnChannel(const struct zbus_channel *channel, const struct zbus_channel *expected);
+int waitForEvent(const zbus_observer *subscriber, event_message_t *message, k_timeout_t timeout);
+int waitForEvent(EventQueue *queue, event_message_t *message, k_timeout_t timeout);
+// Returns the number of events received, the first one within timeout, or a negative error
+int waitForEvents(EventQueue *queue, event_message_t *messages, size_t maxCount, k_timeout_t timeout);
+void getEventStats(event_stats_t *stats);
+// Only for the event channels defined by EventManager
+void getChannelStats(const struct zbus_channel *channel, event_channel_stats_t *stats);
+
+template <size_t N, size_t IdCount>
+void processEvent(const event_message_t *message, const EventDispatchTable<N, IdCount> &dispatchTable) {
+  assert(message);
+
+  dispatchTable.dispatch((uint32_t)message->event.id, message);
+}
+
+// Process a batch of events, in the order they were received
+template <size_t N, size_t IdCount>
+void processEvents(const event_message_t *messages, size_t count, const EventDispatchTable<N, IdCount> &dispatchTable) {
+  size_t index = 0;
+
+  assert(messages);
+
+  for (index = 0; index < count; index++) {
+    processEvent(&messages[index], dispatchTable);
+  }
+}
+
+// Publish an event on the channel of its payload type
+template <typename T>
+int publishEvent(const T *event, k_timeout_t timeout) {
+  static_assert(offsetof(T, id) == 0, "Event payloads must start with their id");
+  assert(event);
+
+  return publishOnChannel(EventChannel<T>::get(), event, timeout);
+}
 
-// Import channel and make it exportable by just including "EventManager.h"
-ZBUS_CHAN_DECLARE(eventsChannel);
+// Payload of a notification received by a listener, NULL if it came from another channel
+template <typename T>
+const T *readEvent(const struct zbus_channel *channel) {
+  return static_cast<const T *>(readOnChannel(channel, EventChannel<T>::get()));
+}
 
 #endif // EVENT_MANAGER_H
\ No newline at end of file
@@ -0,0 +1,72 @@
+/*
+Usage example:
+
+// Lib C includes
+#include <stdint.h>
+#include <stdbool.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/dfu/flash_img.h>
+
+// User C++ class headers
+#include "FlashPipeline.h"
+
+static struct flash_img_context flashContext;
+FlashPipeline pipeline;
+
+// The writer function is called from the flash writer thread, strictly in the order data was queued
+flash_img_init(&flashContext);
+pipeline.start([](const uint8_t *data, size_t length, bool flush) {
+  return flash_img_buffered_write(&flashContext, data, length, flush);
+});
+
+// Producer side (e.g. an HTTP response callback): copies the data and returns right away unless
+// all the slots are waiting to be written
+pipeline.write(fragment, fragmentLength, isLastFragment);
+
+// Zero-copy alternative: receive straight into a slot and queue the part of it holding data
+size_t slotSize = 0;
+uint8_t *slot = pipeline.acquire(&slotSize);
+length = receiveInto(slot, slotSize, &dataStart);
+pipeline.commit(dataStart, length, isLastFragment);
+
+// Wait until everything has been written, returns the first error reported by the writer
+pipeline.drain();
+*/
+
+#ifndef FLASH_PIPELINE_H
+#define FLASH_PIPELINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "InplaceFunction.h"
+
+class FlashPipeline {
+
+public:
+  FlashPipeline();
+  ~FlashPipeline();
+
+  void start(InplaceFunction<int(const uint8_t *, size_t, bool)> writer);
+  int write(const uint8_t *data, size_t length, bool flush);
+  uint8_t *acquire(size_t *size);
+  int commit(const uint8_t *data, size_t length, bool flush);
+  int drain();
+
+  // Time the producer spent blocked on a full pipeline and the writer spent writing
+  uint32_t stallTimeMs;
+  uint32_t writeTimeMs;
+
+private:
+  int32_t currentSlot;
+  size_t currentOffset;
+  size_t currentLength;
+
+  void takeSlot();
+  int submit(bool flush);
+};
+
+#endif // FLASH_PIPELINE_H
@@ -0,0 +1,95 @@
+/*
+Usage example:
+
+// Lib C includes
+#include <stdint.h>
+#include <stdbool.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/dfu/flash_img.h>
+
+// User C++ class headers
+#include "HeatshrinkDecoder.h"
+
+static struct flash_img_context flashContext;
+HeatshrinkDecoder decoder;
+
+// Decompressed data is handed to the writer in blocks of HEATSHRINK_OUTPUT_SIZE bytes
+flash_img_init(&flashContext);
+decoder.start([](const uint8_t *data, size_t length, bool flush) {
+  return flash_img_buffered_write(&flashContext, data, length, flush);
+});
+
+// Feed the compressed stream as it is received, in fragments of any size
+decoder.write(fragment, fragmentLength);
+
+// Hand the last decompressed bytes over with a flush
+decoder.finish();
+printk("%d bytes decompressed in %d ms\r\n", decoder.bytesWritten, decoder.decodeTimeMs);
+
+The stream is the one of the heatshrink encoder (heatshrink -e -w <window bits> -l <lookahead bits>,
+or scripts/compress.py), both sizes must match CONFIG_UPDATER_HEATSHRINK_WINDOW_BITS and
+CONFIG_UPDATER_HEATSHRINK_LOOKAHEAD_BITS. Each item starts with a tag bit, bits are read MSB first:
+  1, byte                                  literal byte
+  0, distance - 1 (window bits), length - 1 (lookahead bits)  copy of earlier output
+*/
+
+#ifndef HEATSHRINK_DECODER_H
+#define HEATSHRINK_DECODER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "InplaceFunction.h"
+
+static constexpr uint32_t HEATSHRINK_WINDOW_BITS = CONFIG_UPDATER_HEATSHRINK_WINDOW_BITS;
+static constexpr uint32_t HEATSHRINK_LOOKAHEAD_BITS = CONFIG_UPDATER_HEATSHRINK_LOOKAHEAD_BITS;
+static constexpr uint32_t HEATSHRINK_WINDOW_SIZE = 1 << HEATSHRINK_WINDOW_BITS;
+// Decompressed bytes handed to the writer at once
+static constexpr uint32_t HEATSHRINK_OUTPUT_SIZE = 256;
+
+enum class HeatshrinkDecoderState {
+  TAG,
+  LITERAL,
+  DISTANCE,
+  LENGTH
+};
+
+class HeatshrinkDecoder {
+
+public:
+  HeatshrinkDecoder();
+
+  void start(InplaceFunction<int(const uint8_t *, size_t, bool)> writer);
+  int write(const uint8_t *data, size_t length);
+  int finish();
+
+  uint32_t bytesWritten;
+  // Time spent decompressing and time spent in the writer
+  uint32_t decodeTimeMs;
+  uint32_t writeTimeMs;
+
+private:
+  InplaceFunction<int(const uint8_t *, size_t, bool)> writer;
+  HeatshrinkDecoderState state;
+  const uint8_t *input;
+  size_t inputLeft;
+  uint32_t bitBuffer;
+  uint32_t bitCount;
+  uint32_t distance;
+  uint32_t windowPosition;
+  size_t outputLength;
+  uint64_t decodeCycles;
+  uint64_t writeCycles;
+  uint8_t window[HEATSHRINK_WINDOW_SIZE];
+  uint8_t output[HEATSHRINK_OUTPUT_SIZE];
+
+  bool readBits(uint32_t count, uint32_t *value);
+  int emit(uint8_t byte);
+  int flush(bool last);
+
+};
+
+#endif // HEATSHRINK_DECODER_H
@@ -42,6 +42,85 @@ static void httpGetRequestThreadHandler() {
     k_msleep(HTTP_CLIENT_THREAD_SLEEP_TIME_MS);
   }
 }
+
+// The server can also be a host name when CONFIG_DNS_RESOLVER is enabled, its address is cached for
+// CONFIG_HTTP_CLIENT_DNS_CACHE_TTL_S and shared by all the clients
+HttpClient namedClient((char *)"example.com", 80);
+
+// HTTPS, the CA certificate of the server must have been added under the security tag first.
+// Needs overlay_tls.conf. Sessions are cached by the TLS sockets so that the following connections
+// to the same server resume them instead of going through a full handshake
+static const unsigned char caCertificate[] = { ... };
+tls_credential_add(1, TLS_CREDENTIAL_CA_CERTIFICATE, caCertificate, sizeof(caCertificate));
+HttpClient secureClient((char *)"example.com", 443);
+secureClient.enableTls(1);
+
+// Keep-alive mode: the TCP connection is opened on the first request and reused by the following
+// ones, if the server closes it in between the client reconnects transparently
+HttpClient telemetryClient((char *)"10.42.0.1", 1880, true);
+
+telemetryClient.post("/telemetry", payload, payloadLength, [](HttpResponse *response) {
+  printk("Status: %d\r\n", response->statusCode);
+});
+
+// Extra header fields are passed through the request options, e.g. to fetch a byte range
+static const char *rangeHeaders[] = {"Range: bytes=1024-\r\n", NULL};
+HttpRequestOptions options = {.headers = rangeHeaders};
+
+client.get("/zephyr.signed.bin", [](HttpResponse *response) {
+  // 206 Partial Content, response->rangeStart is 1024 and response->rangeTotal the file size
+}, &options);
+
+// Large bodies can be received straight into caller memory: the buffer size sets how much data
+// each callback gets, and the optional provider hands out the buffer used after each callback
+static uint8_t pages[2][4096] __aligned(4);
+static uint32_t pageIndex = 0;
+HttpRequestOptions streamOptions = {
+  .buffer = pages[0],
+  .bufferSize = sizeof(pages[0]),
+  .nextBuffer = [](size_t *size) {
+    pageIndex = (pageIndex + 1) % 2;
+    *size = sizeof(pages[pageIndex]);
+    return pages[pageIndex];
+  },
+};
+
+client.get("/zephyr.signed.bin", [](HttpResponse *response) {
+  // response->body points into one of the pages, no copy was made
+}, &streamOptions);
+
+// Asynchronous requests are queued and executed by the HTTP worker threads, the request object
+// must stay valid until its completion is notified
+static struct k_poll_signal requestDone;
+static HttpRequestOptions asyncOptions = {.timeoutMs = 2000};
+static HttpAsyncRequest asyncRequest = {
+  .method = HTTP_GET,
+  .endpoint = "/data",
+  .options = &asyncOptions,
+  .callback = [](HttpResponse *response) { printk("Status: %d\r\n", response->statusCode); },
+  .signal = &requestDone,
+};
+
+k_poll_signal_init(&requestDone);
+client.submit(&asyncRequest);
+
+// ... do something else, then wait for the completion (or use asyncRequest.onComplete)
+struct k_poll_event events[] = {
+  K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &requestDone),
+};
+k_poll(events, 1, K_FOREVER);
+printk("Request result: %d\r\n", asyncRequest.result);
+
+// Timings of the last request of a client, measured from the start of the request
+HttpRequestTiming timing = {0};
+client.getLastTiming(&timing);
+printk("Connected after %d us, first byte after %d us\r\n", timing.connectUs, timing.firstByteUs);
+
+// Statistics of all the clients are also kept per endpoint, they are shown by 'http stats'
+HttpEndpointStats stats = {0};
+for (uint32_t index = 0; HttpClient::getEndpointStats(index, &stats) == 0; index++) {
+  printk("%s: %d requests\r\n", stats.endpoint, stats.requests);
+}
 */
 
 #ifndef HTTP_CLIENT_H
@@ -49,12 +128,28 @@ static void httpGetRequestThreadHandler() {
 
 #include <stdint.h>
 #include <stdbool.h>
-#include <functional>
 
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
 #include <zephyr/net/net_ip.h>
+#include <zephyr/net/tls_credentials.h>
 #include <zephyr/net/http/client.h>
 
+#include "InplaceFunction.h"
+
 static constexpr uint32_t HTTP_CLIENT_RESPONSE_BUFFER_SIZE = 512;
+static constexpr int32_t HTTP_CLIENT_DEFAULT_TIMEOUT_MS = 5000;
+static constexpr uint32_t HTTP_CLIENT_STATS_MAX_ENDPOINTS = 8;
+// Longer entity tags are ignored
+static constexpr size_t HTTP_CLIENT_ETAG_MAX_LENGTH = 64;
+static constexpr uint32_t HTTP_CLIENT_STATS_ENDPOINT_LENGTH = 40;
+// Upper bounds in ms of the request duration histogram buckets, the last bucket has none
+static constexpr uint32_t HTTP_CLIENT_HISTOGRAM_BOUNDS_MS[] = {10, 50, 100, 250, 500, 1000, 5000};
+static constexpr uint32_t HTTP_CLIENT_HISTOGRAM_BUCKETS = ARRAY_SIZE(HTTP_CLIENT_HISTOGRAM_BOUNDS_MS) + 1;
+// The histogram only covers the most recent requests of each endpoint
+static constexpr uint32_t HTTP_CLIENT_HISTOGRAM_WINDOW = 32;
+
+class HttpClient;
 
 typedef struct {
   uint8_t *header;
@@ -64,27 +159,176 @@ typedef struct {
   uint32_t totalSize;
   bool isComplete;
   uint16_t statusCode;
+  // Parsed from the "Content-Range" header of a 206 response, both are 0 when it is absent
+  uint32_t rangeStart;
+  uint32_t rangeTotal;
+  // Strong entity tag of the "ETag" header, NULL when it is absent, weak or too long. Can be sent
+  // back in an "If-Range" header to resume the same version of the resource
+  const char *etag;
 } HttpResponse;
 
+typedef struct {
+  // NULL terminated list of extra header fields, each one ending with "\r\n"
+  const char **headers;
+  // Caller owned receive buffer, the internal HTTP_CLIENT_RESPONSE_BUFFER_SIZE bytes buffer is
+  // used when NULL. The response callback is called each time it is full
+  uint8_t *buffer;
+  size_t bufferSize;
+  // Optional, called after each non final callback to get the buffer the next fragment is received
+  // into, so the previous one can be kept by the caller (e.g. queued for a flash write)
+  InplaceFunction<uint8_t *(size_t *bufferSize)> nextBuffer;
+  // Bounds the connection and the request together, a request sent again over a fresh connection
+  // included, and so is the TLS handshake. The DNS lookup has its own timeout.
+  // HTTP_CLIENT_DEFAULT_TIMEOUT_MS when 0
+  int32_t timeoutMs;
+  // A request over a kept-alive connection the server closed before answering is sent again over a
+  // fresh one. POST requests are only sent again when the server handles duplicates
+  bool retryPost;
+} HttpRequestOptions;
+
+typedef struct HttpAsyncRequest {
+  // Reserved for the request queue
+  void *fifoReserved;
+  enum http_method method;
+  const char *endpoint;
+  const char *data;
+  uint32_t length;
+  const HttpRequestOptions *options;
+  InplaceFunction<void(HttpResponse *)> callback;
+  // Completion notifications, both are optional and are called from the HTTP worker thread
+  InplaceFunction<void(struct HttpAsyncRequest *request)> onComplete;
+  struct k_poll_signal *signal;
+  // Set before the completion is notified, same value as the synchronous get() and post()
+  int result;
+  HttpClient *client;
+} HttpAsyncRequest;
+
+// All the times are in microseconds from the start of the request, resolve, socket and connect
+// times are 0 when a kept-alive connection was reused
+typedef struct {
+  uint32_t resolveUs;
+  uint32_t socketUs;
+  uint32_t connectUs;
+  uint32_t requestSentUs;
+  // End of the first and of the last response fragment handed to the callback
+  uint32_t firstByteUs;
+  uint32_t lastByteUs;
+  uint32_t bytesSent;
+  uint32_t bytesReceived;
+  bool reusedConnection;
+  bool resolvedFromCache;
+  // The TLS handshake is part of the connect time
+  bool tls;
+  int result;
+} HttpRequestTiming;
+
+typedef struct {
+  char endpoint[HTTP_CLIENT_STATS_ENDPOINT_LENGTH];
+  uint32_t requests;
+  uint32_t failures;
+  uint64_t bytesSent;
+  uint64_t bytesReceived;
+  // Sums over the successful requests
+  uint64_t connectUs;
+  uint64_t firstByteUs;
+  uint64_t transferUs;
+  uint64_t totalUs;
+  uint32_t maxTotalUs;
+  uint16_t histogram[HTTP_CLIENT_HISTOGRAM_BUCKETS];
+  HttpRequestTiming last;
+} HttpEndpointStats;
+
+// Host name resolutions of all the clients, dotted-quad addresses are not counted
+typedef struct {
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t failures;
+  // Sums of the resolution times, with and without the cache
+  uint64_t hitUs;
+  uint64_t missUs;
+} HttpDnsStats;
+
 class HttpClient {
 
 public:
-  std::function<void(HttpResponse *response)> callback;
+  InplaceFunction<void(HttpResponse *response)> callback;
 
-  HttpClient(char *server, uint16_t port = 80);
+  HttpClient(char *server, uint16_t port = 80, bool keepAlive = false);
   ~HttpClient();
-  int get(const char *endpoint, std::function<void(HttpResponse *)> callback);
+  int get(const char *endpoint,
+          const InplaceFunction<void(HttpResponse *)> &callback,
+          const HttpRequestOptions *options = NULL);
   int post(const char *endpoint,
            const char *data,
            uint32_t length,
-           std::function<void(HttpResponse *)> callback);
+           const InplaceFunction<void(HttpResponse *)> &callback,
+           const HttpRequestOptions *options = NULL);
+  int submit(HttpAsyncRequest *request);
+  void disconnect();
+  // Called from a response callback, stops receiving the response: the callback isn't called again,
+  // the request fails with -ECONNABORTED and the connection is closed
+  void abort();
+  void getLastTiming(HttpRequestTiming *timing);
+  int enableTls(sec_tag_t secTag, bool cacheSessions = true);
+
+  // Statistics of the requests of all the clients, -ENOENT once index is past the last endpoint
+  static int getEndpointStats(uint32_t index, HttpEndpointStats *stats);
+  static void resetStats();
+  static void getDnsStats(HttpDnsStats *stats);
+  static void flushDnsCache();
+  static int flushTlsSessions();
+
+  // Worker thread side of submit(), not meant to be called directly
+  void execute(HttpAsyncRequest *request);
+  // Request progress notifications, not meant to be called directly
+  void onRequestSent();
+  void onResponseData(uint32_t length, bool isFinal);
+
+  // Set by the response callback once a status line has been received for the current request
+  bool responseReceived;
+  // Set by abort(), the rest of the current response is left unread
+  bool responseAborted;
+  // Content-Range of the current response, parsed once from its first fragment
+  uint32_t rangeStart;
+  uint32_t rangeTotal;
+  // Strong ETag of the current response, empty when there is none
+  char etag[HTTP_CLIENT_ETAG_MAX_LENGTH];
+  // Options of the current request
+  const HttpRequestOptions *options;
 
 private:
   int sock;
   char *server;
   uint16_t port;
+  bool keepAlive;
+  bool tls;
+  sec_tag_t secTag;
+  bool cacheTlsSessions;
+  // Serializes requests, a client can be used by the caller and the HTTP workers at the same time
+  struct k_mutex lock;
   struct sockaddr socketAddress;
   uint8_t responseBuffer[HTTP_CLIENT_RESPONSE_BUFFER_SIZE];
+  int64_t requestStartTicks;
+  HttpRequestTiming timing;
+
+  int resolveServer();
+  int connectToServer(int32_t timeoutMs);
+  int setSocketTimeouts(int32_t timeoutMs);
+  int configureTls();
+  bool connectionIsAlive();
+  uint32_t elapsedUs();
+  int sendRequest(enum http_method method,
+                  const char *endpoint,
+                  const char *data,
+                  uint32_t length,
+                  const InplaceFunction<void(HttpResponse *)> &callback,
+                  const HttpRequestOptions *options);
+  int exchange(enum http_method method,
+               const char *endpoint,
+               const char *data,
+               uint32_t length,
+               const InplaceFunction<void(HttpResponse *)> &callback,
+               const HttpRequestOptions *options);
 
 };
 
@@ -0,0 +1,173 @@
+/*
+Usage example:
+
+// Lib C includes
+#include <stdint.h>
+#include <stdbool.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+
+// User C++ class headers
+#include "InplaceFunction.h"
+
+// Holds any callable with this signature whose captures fit in INPLACE_FUNCTION_DEFAULT_CAPACITY
+// bytes, stored inside the object itself: constructing, copying or assigning it never allocates
+InplaceFunction<void(const char *)> callback = [](const char *message) {
+  printk("%s\r\n", message);
+};
+
+if (callback) {
+  callback("Hello");
+}
+
+// Captures are checked at compile time, a larger capacity can be given for the few that need it
+uint32_t counters[4] = {0};
+InplaceFunction<void(uint32_t), 4 * sizeof(uint32_t)> count = [counters](uint32_t index) mutable {
+  counters[index]++;
+};
+
+// Plain functions are accepted too, and nullptr empties it
+callback = nullptr;
+
+It replaces std::function, which needs the full C++ library (CONFIG_REQUIRES_FULL_LIBCPP) and moves
+the captures of larger lambdas to the heap every time it is constructed or copied.
+*/
+
+#ifndef INPLACE_FUNCTION_H
+#define INPLACE_FUNCTION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+#if __has_include(<new>)
+#include <new>
+#else
+// The minimal C++ library doesn't always provide the placement new
+inline void *operator new(size_t size, void *place) noexcept {
+  (void)size;
+  return place;
+}
+#endif
+
+// Large enough for the lambdas of the application, the largest one captures 5 references
+static constexpr size_t INPLACE_FUNCTION_DEFAULT_CAPACITY = 6 * sizeof(void *);
+
+template <typename Signature, size_t Capacity = INPLACE_FUNCTION_DEFAULT_CAPACITY>
+class InplaceFunction;
+
+template <typename R, typename... Args, size_t Capacity>
+class InplaceFunction<R(Args...), Capacity> {
+
+public:
+  InplaceFunction() : invoker(NULL), manager(NULL) {
+  }
+
+  InplaceFunction(decltype(nullptr)) : InplaceFunction() {
+  }
+
+  InplaceFunction(R (*function)(Args...)) : InplaceFunction() {
+    if (function) {
+      this->store(function);
+    }
+  }
+
+  template <typename F>
+  InplaceFunction(const F &functor) : InplaceFunction() {
+    this->store(functor);
+  }
+
+  InplaceFunction(const InplaceFunction &other) : InplaceFunction() {
+    this->copy(other);
+  }
+
+  ~InplaceFunction() {
+    this->reset();
+  }
+
+  InplaceFunction &operator=(const InplaceFunction &other) {
+    if (this != &other) {
+      this->reset();
+      this->copy(other);
+    }
+
+    return *this;
+  }
+
+  InplaceFunction &operator=(decltype(nullptr)) {
+    this->reset();
+
+    return *this;
+  }
+
+  template <typename F>
+  InplaceFunction &operator=(const F &functor) {
+    this->reset();
+    this->store(functor);
+
+    return *this;
+  }
+
+  explicit operator bool() const {
+    return (this->invoker != NULL);
+  }
+
+  R operator()(Args... args) const {
+    assert(this->invoker);
+
+    // Like std::function, the stored callable isn't const (e.g. mutable lambdas)
+    return this->invoker(const_cast<uint8_t *>(this->storage), static_cast<Args &&>(args)...);
+  }
+
+private:
+  // Calls the stored callable
+  R (*invoker)(void *storage, Args &&...args);
+  // Copy constructs the callable of source into destination, or destroys destination when source
+  // is NULL
+  void (*manager)(void *destination, const void *source);
+  alignas(max_align_t) uint8_t storage[Capacity];
+
+  template <typename F>
+  static R invoke(void *storage, Args &&...args) {
+    return (*static_cast<F *>(storage))(static_cast<Args &&>(args)...);
+  }
+
+  template <typename F>
+  static void manage(void *destination, const void *source) {
+    if (source) {
+      new (destination) F(*static_cast<const F *>(source));
+    } else {
+      static_cast<F *>(destination)->~F();
+    }
+  }
+
+  template <typename F>
+  void store(const F &functor) {
+    static_assert(sizeof(F) <= Capacity, "The captures of this callable don't fit in the InplaceFunction");
+    static_assert(alignof(F) <= alignof(max_align_t), "The captures of this callable are over-aligned");
+
+    new (this->storage) F(functor);
+    this->invoker = &InplaceFunction::invoke<F>;
+    this->manager = &InplaceFunction::manage<F>;
+  }
+
+  void copy(const InplaceFunction &other) {
+    if (other.manager) {
+      other.manager(this->storage, other.storage);
+      this->invoker = other.invoker;
+      this->manager = other.manager;
+    }
+  }
+
+  void reset() {
+    if (this->manager) {
+      this->manager(this->storage, NULL);
+    }
+    this->invoker = NULL;
+    this->manager = NULL;
+  }
+};
+
+#endif // INPLACE_FUNCTION_H
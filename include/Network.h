@@ -14,42 +14,118 @@ Usage example:
 // Get the singleton instance of Network
 Network& network = Network::getInstance();
 
-// Set up the lambda callback for IP address notification
+// Set up the lambda callback for IP address notification, called again when the address changes or
+// comes back after the link or the lease was lost
 network.onGotIP([](const char *ipAddress) {
   printk("Got IP address: %s\r\n", ipAddress);
 });
 
-// Start the network and wait for an IP address
+// Called when the cable is unplugged or the address is lost
+network.onLost([]() {
+  printk("Network lost\r\n");
+});
+
+// Start the network and wait for an IP address. With CONFIG_NETWORK_LEASE_CACHE, the lease saved at
+// the previous boot is used as soon as an ARP probe found no other host using its address, while the
+// DHCP client confirms it
 network.start();
+
+// Link state and time needed to get an address
+network_stats_t stats;
+network.getStats(&stats);
 */
 
 #ifndef NETWORK_H
 #define NETWORK_H
 
 #include <stdint.h>
-#include <functional>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
 #include <zephyr/net/net_if.h>
 #include <zephyr/net/net_mgmt.h>
 
+#include "InplaceFunction.h"
+
+// Lease saved in NVS each time the DHCP client binds or renews it, and periodically while it is bound
+typedef struct {
+  struct in_addr address;
+  struct in_addr netmask;
+  struct in_addr gateway;
+  struct in_addr server;
+  // Time left on the lease when it was saved, an upper bound after a reboot
+  uint32_t remainingS;
+} network_lease_t;
+
+typedef struct {
+  bool linkUp;
+  bool connected;
+  struct in_addr address;
+  // The lease saved at the previous boot was applied before the DHCP client got one
+  bool leaseReused;
+  uint32_t linkDowns;
+  uint32_t addressLosses;
+  // From start() or the last link up to a usable address, and to the DHCP client binding its lease
+  uint32_t timeToIpMs;
+  uint32_t timeToLeaseMs;
+} network_stats_t;
+
 class Network {
 public:
   // Static method to access the singleton instance
   static Network& getInstance();
 
   void start();
-  void onGotIP(std::function<void(const char *)> callback);
+  void onGotIP(InplaceFunction<void(const char *)> callback);
+  void onLost(InplaceFunction<void()> callback);
+  void getStats(network_stats_t *stats);
+#ifdef CONFIG_NETWORK_LEASE_CACHE
+  int forgetLease();
+#endif // CONFIG_NETWORK_LEASE_CACHE
 
-  std::function<void(const char *)> callback;
+  // Not meant to be called directly, used by the net_mgmt callbacks and the lease work items
+  void onEvent(uint32_t event, struct net_if *iface);
+#ifdef CONFIG_NETWORK_LEASE_CACHE
+  void onCachedLeaseExpired();
+  void onLeaseProbeWork();
+  void saveLease();
+#endif // CONFIG_NETWORK_LEASE_CACHE
 
 private:
   // Private constructor to prevent direct instantiation
   Network();
   ~Network();
 
+  bool findAddress(struct net_if *iface, struct in_addr *address);
+  void setConnected(struct net_if *iface);
+  void setDisconnected(const char *reason);
+#ifdef CONFIG_NETWORK_LEASE_CACHE
+  void loadLease();
+  void probeLease();
+  bool leaseProbeAnswered();
+  void reuseLease();
+  void onLeaseBound(struct net_if *iface);
+#endif // CONFIG_NETWORK_LEASE_CACHE
+
   // Static member to hold the singleton instance
   static Network instance;
   struct net_mgmt_event_callback mgmtEventCb;
+  struct net_mgmt_event_callback linkEventCb;
   struct net_if *netIface;
+  InplaceFunction<void(const char *)> callback;
+  InplaceFunction<void()> lostCallback;
+  struct in_addr address;
+  int64_t connectStartTime;
+  bool leaseBound;
+  network_stats_t stats;
+#ifdef CONFIG_NETWORK_LEASE_CACHE
+  network_lease_t cachedLease;
+  // The saved lease waits for the link and the ARP probe before its address is applied
+  bool cachedLeasePending;
+  bool cachedLeaseApplied;
+  int leaseProbeSock;
+  int64_t leaseBoundTime;
+  uint32_t leaseTimeS;
+#endif // CONFIG_NETWORK_LEASE_CACHE
 };
 
 #endif // NETWORK_H
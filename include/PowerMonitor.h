@@ -0,0 +1,60 @@
+/*
+Usage example:
+
+// Lib C includes
+#include <stdint.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+
+// User C++ class headers
+#include "PowerMonitor.h"
+
+power_stats_t stats = {0};
+
+// Idle time and idle wakeups are taken from the idle thread runtime statistics, low-power
+// entries and residency from the power management notifications when CONFIG_PM is enabled
+PowerMonitor::getInstance().getStats(&stats);
+printk("Idle %lld of %lld us, %lld idle wakeups\r\n", stats.idleUs, stats.uptimeUs, stats.idleWakeups);
+*/
+
+#ifndef POWER_MONITOR_H
+#define POWER_MONITOR_H
+
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+
+typedef struct {
+  uint64_t uptimeUs;
+  uint64_t idleUs;
+  uint64_t idleWakeups;
+  uint32_t lowPowerEntries;
+  uint64_t lowPowerUs;
+} power_stats_t;
+
+class PowerMonitor {
+public:
+  // Static method to access the singleton instance
+  static PowerMonitor& getInstance();
+
+  void getStats(power_stats_t *stats);
+
+  // Power management notifications, not meant to be called directly
+  void onLowPowerEntry();
+  void onLowPowerExit();
+
+private:
+  // Private constructor to prevent direct instantiation
+  PowerMonitor();
+  ~PowerMonitor();
+
+  // Static member to hold the singleton instance
+  static PowerMonitor instance;
+  uint32_t lowPowerEntries;
+  uint32_t lowPowerEntryCycles;
+  uint64_t lowPowerCycles;
+};
+
+#endif // POWER_MONITOR_H
@@ -0,0 +1,73 @@
+/*
+Usage example:
+
+// Lib C includes
+#include <stdint.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+
+// User C++ class headers
+#include "RangeDownloader.h"
+
+// Create local object, the ranges are fetched by worker threads over kept-alive connections
+RangeDownloader downloader((char *)"192.168.1.25", 80);
+
+// Download the whole file over 4 connections, fragments are always delivered in order, formatted
+// like the 206 Partial Content response of a single "Range: bytes=0-" request
+downloader.download("/zephyr.signed.bin", 0, 4, [](HttpResponse *response) {
+  printk("%d/%d bytes\r\n", response->bodyLength, response->rangeTotal);
+  return 0;
+});
+*/
+
+#ifndef RANGE_DOWNLOADER_H
+#define RANGE_DOWNLOADER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <zephyr/kernel.h>
+
+#include "InplaceFunction.h"
+#include "HttpClient.h"
+
+class RangeDownloader {
+
+public:
+  RangeDownloader(char *server, uint16_t port = 80);
+  ~RangeDownloader();
+
+  // Returns 0 on success, -ENOTSUP if the server doesn't support range requests. With an entity tag,
+  // the ranges are only accepted from that version of the file ("If-Range"), otherwise from the
+  // version the first range comes from. The fragments carry the entity tag they were checked against
+  int download(const char *endpoint,
+               uint32_t offset,
+               uint8_t streams,
+               InplaceFunction<int(HttpResponse *)> callback,
+               const char *etag = NULL);
+
+  // Worker thread entry point, not meant to be called directly
+  void runStream();
+
+private:
+  char *server;
+  uint16_t port;
+  const char *endpoint;
+  uint32_t offset;
+  uint32_t totalSize;
+  char etag[HTTP_CLIENT_ETAG_MAX_LENGTH];
+  uint32_t chunkCount;
+  uint32_t nextChunk;
+  uint32_t writtenChunk;
+  int error;
+  struct k_mutex mutex;
+  struct k_condvar condition;
+
+  int fetchChunk(HttpClient *client, uint32_t chunk, uint8_t *buffer, uint32_t *length);
+  int claimChunk();
+  void releaseChunk(uint32_t chunk, uint32_t length, int ret);
+};
+
+#endif // RANGE_DOWNLOADER_H
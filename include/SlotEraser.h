@@ -0,0 +1,95 @@
+/*
+Usage example:
+
+// Lib C includes
+#include <stdint.h>
+#include <stdbool.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/storage/flash_map.h>
+
+// User C++ class headers
+#include "SlotEraser.h"
+
+SlotEraser &eraser = SlotEraser::getInstance();
+
+// Erase slot1 from a low priority thread, sector by sector, keeping the first 64 kB (e.g. a download
+// to resume). Sectors that are already blank are only read, not erased again
+eraser.start(FIXED_PARTITION_ID(slot1_partition), 64 * 1024);
+
+// Before writing a range, erase the sectors it covers that are not clean yet, clean ones are skipped
+eraser.prepare(offset, length);
+
+// A new download starting at 0 makes the sectors written so far dirty again
+eraser.seek(0);
+
+// Erase what is left synchronously (e.g. before writing the MCUboot trailer)
+eraser.finish();
+*/
+
+#ifndef SLOT_ERASER_H
+#define SLOT_ERASER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <zephyr/storage/flash_map.h>
+
+static constexpr uint32_t SLOT_ERASER_MAX_SECTORS = CONFIG_UPDATER_ERASE_MAX_SECTORS;
+// Bytes read at once when checking whether a sector is blank
+static constexpr size_t SLOT_ERASER_READ_SIZE = 256;
+
+enum class SectorState : uint8_t {
+  // Content unknown, must be erased before being written
+  DIRTY,
+  // Erased and not written since
+  CLEAN,
+  // Erased, then written by the current download
+  WRITING
+};
+
+typedef struct {
+  uint32_t sectorCount;
+  uint32_t cleanSectors;
+  uint32_t blankSectors;
+  uint32_t backgroundErases;
+  uint32_t onDemandErases;
+  uint32_t backgroundEraseTimeMs;
+  uint32_t onDemandEraseTimeMs;
+} slot_eraser_stats_t;
+
+class SlotEraser {
+public:
+  // Static method to access the singleton instance
+  static SlotEraser& getInstance();
+
+  int start(uint8_t partitionId, size_t keepSize);
+  size_t resumableOffset(size_t offset);
+  void seek(size_t offset);
+  int prepare(size_t offset, size_t length);
+  int finish();
+  void getStats(slot_eraser_stats_t *stats);
+
+  // Not meant to be called directly, used by the background thread
+  bool cleanNextSector();
+
+private:
+  // Private constructor to prevent direct instantiation
+  SlotEraser();
+  ~SlotEraser();
+
+  int cleanSector(uint32_t sector, bool onDemand);
+  bool isBlank(off_t offset, size_t length);
+
+  // Static member to hold the singleton instance
+  static SlotEraser instance;
+  const struct flash_area *area;
+  struct flash_sector sectors[SLOT_ERASER_MAX_SECTORS];
+  SectorState states[SLOT_ERASER_MAX_SECTORS];
+  uint8_t buffer[SLOT_ERASER_READ_SIZE];
+  slot_eraser_stats_t stats;
+};
+
+#endif // SLOT_ERASER_H
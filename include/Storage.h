@@ -0,0 +1,72 @@
+/*
+Usage example:
+
+// Lib C includes
+#include <stdint.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+
+// User C++ class headers
+#include "Storage.h"
+
+uint32_t downloadOffset = 0;
+
+// Get the singleton instance of Storage, the NVS file system is mounted on first access
+Storage& storage = Storage::getInstance();
+
+// Read the previous value, if the entry doesn't exist yet a negative error code is returned
+if (storage.read(STORAGE_ID_DOWNLOAD_PROGRESS, &downloadOffset, sizeof(downloadOffset)) < 0) {
+  downloadOffset = 0;
+}
+printk("Resuming download from offset: %d\r\n", downloadOffset);
+
+// Persist the new value in the storage_partition
+downloadOffset += 4096;
+storage.write(STORAGE_ID_DOWNLOAD_PROGRESS, &downloadOffset, sizeof(downloadOffset));
+
+// Remove the entry once it is not needed anymore
+storage.remove(STORAGE_ID_DOWNLOAD_PROGRESS);
+*/
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <zephyr/fs/nvs.h>
+
+// NVS entry identifiers, each entry is owned by a single module
+typedef enum {
+  STORAGE_ID_INITIAL_VALUE = 0,
+  STORAGE_ID_DOWNLOAD_PROGRESS,
+  STORAGE_ID_BOOT_HISTORY,
+  STORAGE_ID_NETWORK_LEASE,
+  STORAGE_ID_MAX_VALUE
+} storage_id_t;
+
+class Storage {
+public:
+  // Static method to access the singleton instance
+  static Storage& getInstance();
+
+  ssize_t read(storage_id_t id, void *data, size_t length);
+  ssize_t write(storage_id_t id, const void *data, size_t length);
+  int remove(storage_id_t id);
+
+private:
+  // Private constructor to prevent direct instantiation
+  Storage();
+  ~Storage();
+
+  int mount();
+
+  // Static member to hold the singleton instance
+  static Storage instance;
+  struct nvs_fs fs;
+  bool isMounted;
+};
+
+#endif // STORAGE_H
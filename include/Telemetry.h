@@ -0,0 +1,120 @@
+/*
+Usage example:
+
+// Lib C includes
+#include <stdint.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+
+// User C++ class headers
+#include "Temperature.h"
+#include "Telemetry.h"
+
+// The sensor object must outlive the telemetry registration
+static Temperature temperature(DEVICE_DT_GET(DT_NODELABEL(die_temp)));
+temperature.start();
+
+// Register the sensor, readings are fixed-point values (here hundredths of a degree Celsius). The
+// callback runs from the sampling work, it must not block
+Telemetry::getInstance().addSensor(TELEMETRY_SENSOR_DIE_TEMPERATURE, [](int16_t *value) {
+  temperature_reading_t reading;
+  int ret = temperature.read(&reading);
+
+  if (ret == 0) {
+    *value = (int16_t)(reading.milliCelsius / 10);
+  }
+  return ret;
+});
+
+// Start sampling every CONFIG_TELEMETRY_SAMPLE_PERIOD_MS, batches are uploaded once the network
+// is available (EVENT_NETWORK_AVAILABLE)
+Telemetry::getInstance().start();
+
+Upload format (little endian), sent as application/octet-stream:
+
+  uint8_t  version          TELEMETRY_FORMAT_VERSION
+  uint16_t recordCount
+  uint32_t baseTimestampMs  uptime of the first record
+  records[recordCount]:
+    uint8_t  sensor
+    uint16_t deltaDs        time since the previous record in 1/10 s, 0 for the first record
+    int16_t  value          fixed-point reading
+*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <zephyr/kernel.h>
+
+#include "InplaceFunction.h"
+#include "HttpClient.h"
+
+static constexpr uint8_t TELEMETRY_FORMAT_VERSION = 1;
+static constexpr uint8_t TELEMETRY_MAX_SENSORS = 4;
+
+// Sensor identifiers, as sent to the server
+typedef enum {
+  TELEMETRY_SENSOR_DIE_TEMPERATURE = 0,
+} telemetry_sensor_t;
+
+typedef struct {
+  uint32_t samples;
+  uint32_t dropped;
+  uint32_t posts;
+  uint32_t failedPosts;
+  uint32_t samplesSent;
+  uint32_t bytesSent;
+} telemetry_stats_t;
+
+class Telemetry {
+public:
+  // Static method to access the singleton instance
+  static Telemetry& getInstance();
+
+  int addSensor(telemetry_sensor_t sensor, InplaceFunction<int(int16_t *value)> read);
+  void start();
+  void setNetworkAvailable(bool available);
+  void getStats(telemetry_stats_t *stats);
+
+  // Work handlers, not meant to be called directly
+  void sample();
+  void onPostComplete(HttpAsyncRequest *request);
+
+private:
+  // Private constructor to prevent direct instantiation
+  Telemetry();
+  ~Telemetry();
+
+  typedef struct {
+    telemetry_sensor_t id;
+    InplaceFunction<int(int16_t *value)> read;
+  } sensor_t;
+
+  // Static member to hold the singleton instance
+  static Telemetry instance;
+  sensor_t sensors[TELEMETRY_MAX_SENSORS];
+  uint8_t sensorCount;
+  bool networkIsAvailable;
+  bool postInFlight;
+  uint16_t recordsInFlight;
+  uint32_t droppedInFlight;
+  int responseStatus;
+  telemetry_stats_t stats;
+  struct k_mutex mutex;
+  struct k_work_delayable sampleWork;
+  HttpClient client;
+  HttpRequestOptions options;
+  HttpAsyncRequest request;
+
+  void push(telemetry_sensor_t sensor, int16_t value, uint32_t timestampMs);
+  void pop(uint32_t count);
+  bool shouldFlush(uint32_t nowMs);
+  void flush();
+};
+
+#endif // TELEMETRY_H
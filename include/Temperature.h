@@ -12,36 +12,112 @@ Usage example:
 // User C++ class headers
 #include "Temperature.h"
 
-// Variable to hold temperature reading in Celsius
-double temperatureReading = 0;
+// Reference die temperature device from device tree, the object must outlive the sampling
+static Temperature temperature(DEVICE_DT_GET(DT_NODELABEL(die_temp)));
 
-// Reference die temperature device from device tree
-const struct device *temperatureDevice = DEVICE_DT_GET(DT_NODELABEL(die_temp));
+// Sample every CONFIG_TEMPERATURE_SAMPLE_PERIOD_MS from the system work queue, each sample is the
+// average of CONFIG_TEMPERATURE_OVERSAMPLING fetches
+temperature.start();
 
-// Create local object using the device
-Temperature temperature(temperatureDevice);
-
-// Continuously read temperature
+// Never blocks: returns the latest moving average, and the minimum and maximum of the last
+// CONFIG_TEMPERATURE_MINMAX_WINDOW samples, all in thousandths of a degree Celsius
+temperature_reading_t reading;
 while (true) {
-  temperatureReading = temperature.read();
-  printk("CPU temperature: %.1f °C\r\n", temperatureReading);
+  if (temperature.read(&reading) == 0) {
+    printk("CPU temperature: %d.%03d °C\r\n", reading.milliCelsius / 1000, abs(reading.milliCelsius % 1000));
+  }
   k_msleep(1000);
 }
+
+// Without sampling, a single blocking measurement
+int32_t milliCelsius = 0;
+temperature.measure(&milliCelsius);
+
+The 'temperature' shell command shows the latest reading of the last started sensor, and with
+CONFIG_TEMPERATURE_BENCHMARK 'temperature bench' compares the cycles needed by the double and the
+fixed-point conversions.
 */
 
 #ifndef TEMPERATURE_H
 #define TEMPERATURE_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/sensor.h>
+
+class Temperature;
+
+// Kernel objects used while sampling, kept together so the handler can get back to its sensor
+typedef struct {
+  struct k_work_delayable sampleWork;
+  Temperature *temperature;
+} temperature_context_t;
+
+// All the temperatures are in thousandths of a degree Celsius
+typedef struct {
+  // Moving average of the last CONFIG_TEMPERATURE_AVERAGE_WINDOW samples
+  int32_t milliCelsius;
+  // Over the last CONFIG_TEMPERATURE_MINMAX_WINDOW samples
+  int32_t minMilliCelsius;
+  int32_t maxMilliCelsius;
+  // Uptime of the last sample
+  int64_t timestampMs;
+  uint32_t samples;
+} temperature_reading_t;
+
+typedef struct {
+  uint32_t samples;
+  uint32_t fetches;
+  uint32_t failedFetches;
+  uint32_t failedSamples;
+  int lastError;
+  // Reads that had to copy the reading again because a sample was published meanwhile
+  uint32_t readRetries;
+} temperature_stats_t;
+
 class Temperature {
 
 public:
   Temperature(const struct device *device);
   ~Temperature();
-  double read();
+
+  int start(uint32_t periodMs = CONFIG_TEMPERATURE_SAMPLE_PERIOD_MS);
+  void stop();
+  int read(temperature_reading_t *reading);
+  int measure(int32_t *milliCelsius);
+  void getStats(temperature_stats_t *stats);
+  const struct device *getDevice();
+
+  static int32_t toMilliCelsius(const struct sensor_value *value);
+
+  // Work handler, not meant to be called directly
+  void sample();
 
 private:
   const struct device *device;
+  uint32_t periodMs;
+  bool isSampling;
+  temperature_context_t context;
+
+  // Windows of the last samples, only written by the sampling work
+  int32_t averageWindow[CONFIG_TEMPERATURE_AVERAGE_WINDOW];
+  int64_t averageSum;
+  int32_t minMaxWindow[CONFIG_TEMPERATURE_MINMAX_WINDOW];
+  uint32_t samples;
+
+  // Latest value cache: the reading is published into the buffer the sequence doesn't point to,
+  // then the sequence moves to it. Readers never wait for the sampling work, they copy again when
+  // the sequence moved while they were copying
+  temperature_reading_t readings[2];
+  atomic_t sequence;
+  atomic_t readRetries;
+  struct k_mutex mutex;
+  temperature_stats_t stats;
+
+  void publish(const temperature_reading_t *reading);
 
 };
 
-#endif // TEMPERATURE_H
\ No newline at end of file
+#endif // TEMPERATURE_H
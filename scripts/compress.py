@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""Compress a signed image for the HeatshrinkDecoder class.
+
+The output is a heatshrink stream, the window and lookahead sizes must match the
+CONFIG_UPDATER_HEATSHRINK_WINDOW_BITS and CONFIG_UPDATER_HEATSHRINK_LOOKAHEAD_BITS of the devices:
+
+    python3 compress.py build/zephyr/zephyr.signed.bin -o /var/www/html/zephyr.signed.bin.hs
+
+See include/HeatshrinkDecoder.h for the format.
+"""
+
+import argparse
+import sys
+
+# Candidates tried per position, long runs of padding would make the search quadratic otherwise
+MAX_CANDIDATES = 32
+# Matches are searched from their first bytes
+SEED_LENGTH = 3
+
+
+class BitWriter:
+    def __init__(self):
+        self.output = bytearray()
+        self.buffer = 0
+        self.count = 0
+
+    def write(self, value, count):
+        self.buffer = (self.buffer << count) | value
+        self.count += count
+        while self.count >= 8:
+            self.count -= 8
+            self.output.append((self.buffer >> self.count) & 0xFF)
+        self.buffer &= (1 << self.count) - 1
+
+    def finish(self):
+        # Padding is shorter than any item, the decoder ignores it
+        if self.count:
+            self.output.append((self.buffer << (8 - self.count)) & 0xFF)
+        return bytes(self.output)
+
+
+def compress(data, window_bits, lookahead_bits):
+    window_size = 1 << window_bits
+    max_length = 1 << lookahead_bits
+    # A back-reference is only worth it when it is shorter than the literals it replaces
+    min_length = (1 + window_bits + lookahead_bits) // 9 + 1
+    chains = {}
+    writer = BitWriter()
+    position = 0
+
+    while position < len(data):
+        best_length = 0
+        best_distance = 0
+        limit = min(max_length, len(data) - position)
+        if limit >= SEED_LENGTH:
+            for candidate in reversed(chains.get(data[position:position + SEED_LENGTH], [])):
+                if position - candidate > window_size:
+                    break
+                length = 0
+                # Overlapping copies are fine, the decoder copies a byte at a time
+                while length < limit and data[candidate + length] == data[position + length]:
+                    length += 1
+                if length > best_length:
+                    best_length = length
+                    best_distance = position - candidate
+                    if length == limit:
+                        break
+
+        if best_length >= max(min_length, SEED_LENGTH):
+            writer.write(0, 1)
+            writer.write(best_distance - 1, window_bits)
+            writer.write(best_length - 1, lookahead_bits)
+            step = best_length
+        else:
+            writer.write(1, 1)
+            writer.write(data[position], 8)
+            step = 1
+
+        for index in range(position, min(position + step, len(data) - SEED_LENGTH + 1)):
+            chain = chains.setdefault(data[index:index + SEED_LENGTH], [])
+            chain.append(index)
+            if len(chain) > MAX_CANDIDATES:
+                del chain[0]
+        position += step
+
+    return writer.finish()
+
+
+def decompress(stream, window_bits, lookahead_bits):
+    """Same algorithm as HeatshrinkDecoder, used to check the output before it is published."""
+    output = bytearray()
+    bits = 0
+    count = 0
+    position = 0
+
+    def read(size):
+        nonlocal bits, count, position
+        while count < size:
+            if position == len(stream):
+                return None
+            bits = (bits << 8) | stream[position]
+            count += 8
+            position += 1
+        count -= size
+        value = (bits >> count) & ((1 << size) - 1)
+        bits &= (1 << count) - 1
+        return value
+
+    while True:
+        tag = read(1)
+        if tag is None:
+            break
+        if tag:
+            value = read(8)
+            if value is None:
+                break
+            output.append(value)
+        else:
+            distance = read(window_bits)
+            length = read(lookahead_bits)
+            if distance is None or length is None:
+                break
+            for _ in range(length + 1):
+                index = len(output) - (distance + 1)
+                output.append(output[index] if index >= 0 else 0)
+    return bytes(output)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("image", help="signed image to compress")
+    parser.add_argument("-o", "--output", required=True, help="compressed image")
+    parser.add_argument("-w", "--window-bits", type=int, default=10,
+                        help="CONFIG_UPDATER_HEATSHRINK_WINDOW_BITS")
+    parser.add_argument("-l", "--lookahead-bits", type=int, default=5,
+                        help="CONFIG_UPDATER_HEATSHRINK_LOOKAHEAD_BITS")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as file:
+        image = file.read()
+
+    stream = compress(image, args.window_bits, args.lookahead_bits)
+    if decompress(stream, args.window_bits, args.lookahead_bits) != image:
+        print("Compressed image doesn't decompress to the original", file=sys.stderr)
+        return 1
+
+    with open(args.output, "wb") as file:
+        file.write(stream)
+    print("%s: %d bytes (%d%% of the image)" % (args.output, len(stream), (100 * len(stream)) // max(len(image), 1)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,235 @@
+#!/usr/bin/env python3
+"""Generate the delta patches applied by the DeltaPatcher class.
+
+The patch rebuilds NEW from OLD, both being signed images as found in the slots. It is named after
+the version of OLD found in its MCUboot header, which is the name the updater asks for:
+
+    python3 delta.py old/zephyr.signed.bin build/zephyr/zephyr.signed.bin -o /var/www/html/patches
+    -> /var/www/html/patches/1.2.0+0.bin
+
+See include/DeltaPatcher.h for the format.
+"""
+
+import argparse
+import hashlib
+import os
+import struct
+import sys
+
+PATCH_MAGIC = b"ZDP1"
+MCUBOOT_MAGIC = 0x96F3B83D
+# Matches shorter than this are inserted as is instead
+SEED_LENGTH = 8
+# Source positions remembered per seed, long runs of padding would fill the index otherwise
+MAX_POSITIONS_PER_SEED = 16
+# Bytes compared when ranking the candidates of a seed
+RANKING_LENGTH = 64
+
+# Operations, the low 2 bits of the varint that starts each of them
+OP_COPY = 0
+OP_ADD = 1
+OP_INSERT = 2
+OP_SEEK = 3
+# Equal runs shorter than this are folded into the surrounding ADD, an operation costs at least a byte
+MIN_COPY_LENGTH = 4
+
+
+def image_version(image):
+    magic, _, _, _, _, _, major, minor, revision, build = struct.unpack_from("<IIHHIIBBHI", image)
+    if magic != MCUBOOT_MAGIC:
+        raise ValueError("not an MCUboot image")
+    return "%d.%d.%d+%d" % (major, minor, revision, build)
+
+
+def index_source(source):
+    index = {}
+    for position in range(len(source) - SEED_LENGTH + 1):
+        positions = index.setdefault(source[position:position + SEED_LENGTH], [])
+        if len(positions) < MAX_POSITIONS_PER_SEED:
+            positions.append(position)
+    return index
+
+
+def forward_length(source, source_start, target, target_start, limit=None):
+    """Length of the approximate match, extended while at least half of the bytes are equal."""
+    length = min(len(source) - source_start, len(target) - target_start)
+    if limit is not None:
+        length = min(length, limit)
+    matches = 0
+    best_score = 0
+    best_length = 0
+    for offset in range(length):
+        if source[source_start + offset] == target[target_start + offset]:
+            matches += 1
+        if (2 * matches - offset) > (2 * best_score - best_length):
+            best_score = matches
+            best_length = offset + 1
+    return best_length
+
+
+def find_match(index, source, target, start, expected):
+    """First target position at or after start where a source match begins, with its source position."""
+    for target_position in range(start, len(target) - SEED_LENGTH + 1):
+        # Continuing where the previous match stopped is the common case after a small change
+        if (0 <= expected <= len(source) - SEED_LENGTH and
+                source[expected:expected + SEED_LENGTH] ==
+                target[target_position:target_position + SEED_LENGTH]):
+            return target_position, expected
+        candidates = index.get(target[target_position:target_position + SEED_LENGTH])
+        if candidates:
+            best = max(candidates,
+                       key=lambda position: forward_length(source, position, target,
+                                                           target_position, RANKING_LENGTH))
+            return target_position, best
+        expected += 1
+    return None
+
+
+def varint(value):
+    encoded = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            encoded.append(byte | 0x80)
+        else:
+            encoded.append(byte)
+            return bytes(encoded)
+
+
+def operation(op, value, payload=b""):
+    return varint((value << 2) | op) + payload
+
+
+def zigzag(value):
+    return (value << 1) if value >= 0 else ((-value << 1) - 1)
+
+
+def encode_match(source, source_position, target, target_position, length):
+    """COPY the equal runs and ADD the differences of an approximate match."""
+    runs = []
+    offset = 0
+    while offset < length:
+        start = offset
+        equal = source[source_position + offset] == target[target_position + offset]
+        while (offset < length and
+               (source[source_position + offset] == target[target_position + offset]) == equal):
+            offset += 1
+        copy = equal and (offset - start) >= MIN_COPY_LENGTH
+        if not copy and runs and not runs[-1][0]:
+            runs[-1] = (False, runs[-1][1], offset)
+        else:
+            runs.append((copy, start, offset))
+
+    encoded = bytearray()
+    for copy, start, end in runs:
+        if copy:
+            encoded += operation(OP_COPY, end - start)
+        else:
+            delta = bytes((target[target_position + index] - source[source_position + index]) & 0xFF
+                          for index in range(start, end))
+            encoded += operation(OP_ADD, len(delta), delta)
+    return bytes(encoded)
+
+
+def diff(source, target):
+    index = index_source(source)
+    body = bytearray()
+    source_offset = 0
+    target_offset = 0
+
+    while target_offset < len(target):
+        match = find_match(index, source, target, target_offset, source_offset)
+        if not match:
+            body += operation(OP_INSERT, len(target) - target_offset, target[target_offset:])
+            break
+        target_position, source_position = match
+        if target_position > target_offset:
+            body += operation(OP_INSERT, target_position - target_offset,
+                              target[target_offset:target_position])
+        if source_position != source_offset:
+            body += operation(OP_SEEK, zigzag(source_position - source_offset))
+        length = max(forward_length(source, source_position, target, target_position), SEED_LENGTH)
+        length = min(length, len(target) - target_position, len(source) - source_position)
+        body += encode_match(source, source_position, target, target_position, length)
+        source_offset = source_position + length
+        target_offset = target_position + length
+
+    return bytes(body)
+
+
+def make_patch(source, target):
+    header = PATCH_MAGIC + struct.pack("<II", len(source), len(target))
+    header += hashlib.sha256(source).digest() + hashlib.sha256(target).digest()
+    return header + diff(source, target)
+
+
+def read_varint(patch, position):
+    value = 0
+    shift = 0
+    while True:
+        byte = patch[position]
+        position += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, position
+
+
+def apply_patch(source, patch):
+    """Same algorithm as DeltaPatcher, used to check a patch before it is published."""
+    if patch[:4] != PATCH_MAGIC:
+        raise ValueError("not a delta patch")
+    source_size, target_size = struct.unpack_from("<II", patch, 4)
+    if hashlib.sha256(source[:source_size]).digest() != patch[12:44]:
+        raise ValueError("patch was not made for this source")
+    target = bytearray()
+    position = 76
+    source_offset = 0
+    while len(target) < target_size:
+        value, position = read_varint(patch, position)
+        op = value & 0x03
+        value >>= 2
+        if op == OP_COPY:
+            target += source[source_offset:source_offset + value]
+            source_offset += value
+        elif op == OP_ADD:
+            for offset in range(value):
+                target.append((source[source_offset + offset] + patch[position + offset]) & 0xFF)
+            position += value
+            source_offset += value
+        elif op == OP_INSERT:
+            target += patch[position:position + value]
+            position += value
+        else:
+            source_offset += (value >> 1) if not value & 1 else -((value + 1) >> 1)
+    if position != len(patch) or hashlib.sha256(target).digest() != patch[44:76]:
+        raise ValueError("rebuilt image doesn't match")
+    return bytes(target)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("old", help="signed image running on the devices")
+    parser.add_argument("new", help="signed image to update them to")
+    parser.add_argument("-o", "--output", default=".", help="directory the patch is written to")
+    args = parser.parse_args()
+
+    with open(args.old, "rb") as file:
+        source = file.read()
+    with open(args.new, "rb") as file:
+        target = file.read()
+
+    patch = make_patch(source, target)
+    apply_patch(source, patch)
+
+    os.makedirs(args.output, exist_ok=True)
+    path = os.path.join(args.output, image_version(source) + ".bin")
+    with open(path, "wb") as file:
+        file.write(patch)
+    print("%s: %d bytes (%d%% of the image)" % (path, len(patch), (100 * len(patch)) // max(len(target), 1)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
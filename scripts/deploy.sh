@@ -1,2 +1,10 @@
+# Publish a patch against the image currently served, devices running it download the patch instead
+if [ -f /var/www/html/zephyr.signed.bin ]; then
+    sudo python3 "$(dirname "$0")/delta.py" /var/www/html/zephyr.signed.bin ../build/zephyr/zephyr.signed.bin -o /var/www/html/patches
+fi
 sudo rm -rf /var/www/html/zephyr.signed.bin
-sudo cp ../build/zephyr/zephyr.signed.bin /var/www/html/
\ No newline at end of file
+sudo cp ../build/zephyr/zephyr.signed.bin /var/www/html/
+# Compressed copy of the same image, devices without a patch download it instead of the raw one
+sudo python3 "$(dirname "$0")/compress.py" ../build/zephyr/zephyr.signed.bin -o /var/www/html/zephyr.signed.bin.hs
+# Manifest checked against the SHA-256 the devices compute while writing the image
+printf "%s %s\n" "$(sha256sum ../build/zephyr/zephyr.signed.bin | cut -c1-64)" "$(stat -c %s ../build/zephyr/zephyr.signed.bin)" | sudo tee /var/www/html/zephyr.signed.bin.manifest > /dev/null
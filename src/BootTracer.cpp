@@ -0,0 +1,289 @@
+// Lib C
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(BootTracer);
+
+// User C++ class headers
+#include "BootTracer.h"
+#ifdef CONFIG_BOOT_TRACER_HISTORY
+#include "Storage.h"
+#endif // CONFIG_BOOT_TRACER_HISTORY
+
+static int bootTracerInit();
+static int shellBootTraceCommandHandler(const struct shell *shell, size_t argc, char **argv);
+#ifdef CONFIG_BOOT_TRACER_HISTORY
+static void persistWorkHandler(struct k_work *work);
+static int shellBootHistoryCommandHandler(const struct shell *shell, size_t argc, char **argv);
+#endif // CONFIG_BOOT_TRACER_HISTORY
+
+// Shell command registration
+#ifdef CONFIG_BOOT_TRACER_HISTORY
+SHELL_STATIC_SUBCMD_SET_CREATE(
+  bootSubcommands,
+  SHELL_CMD(trace, NULL, "Milestones of the current boot", shellBootTraceCommandHandler),
+  SHELL_CMD(history, NULL, "Milestones of the last boots saved in NVS", shellBootHistoryCommandHandler),
+  SHELL_SUBCMD_SET_END
+);
+#else
+SHELL_STATIC_SUBCMD_SET_CREATE(
+  bootSubcommands,
+  SHELL_CMD(trace, NULL, "Milestones of the current boot", shellBootTraceCommandHandler),
+  SHELL_SUBCMD_SET_END
+);
+#endif // CONFIG_BOOT_TRACER_HISTORY
+SHELL_CMD_REGISTER(boot, &bootSubcommands, "Boot milestones", NULL);
+
+// First application code to run once the kernel is up
+SYS_INIT(bootTracerInit, APPLICATION, 0);
+
+static const char *const milestoneNames[BOOT_MILESTONE_COUNT] = {
+  "Kernel ready",
+  "main() started",
+  "Network started",
+  "Got IP",
+  "Image confirmed",
+  "Updater ready",
+  "First HTTP request",
+  "First HTTP response"
+};
+
+// Only the first occurrence of each milestone is kept
+ATOMIC_DEFINE(reachedMilestones, BOOT_MILESTONE_COUNT);
+
+#ifdef CONFIG_BOOT_TRACER_HISTORY
+// Saved once every milestone has been reached, or after a delay for the boots that never reach some
+K_WORK_DELAYABLE_DEFINE(persistWork, persistWorkHandler);
+#endif // CONFIG_BOOT_TRACER_HISTORY
+
+static int bootTracerInit() {
+  BootTracer::getInstance().mark(BootMilestone::KERNEL_READY);
+#ifdef CONFIG_BOOT_TRACER_HISTORY
+  k_work_schedule(&persistWork, K_SECONDS(CONFIG_BOOT_TRACER_HISTORY_DELAY_S));
+#endif // CONFIG_BOOT_TRACER_HISTORY
+
+  return 0;
+}
+
+#ifdef CONFIG_BOOT_TRACER_HISTORY
+static void persistWorkHandler(struct k_work *work) {
+  ARG_UNUSED(work);
+
+  BootTracer::getInstance().persist();
+}
+#endif // CONFIG_BOOT_TRACER_HISTORY
+
+// Define the static member
+BootTracer BootTracer::instance;
+
+BootTracer& BootTracer::getInstance() {
+  // Return the singleton instance
+  return instance;
+}
+
+BootTracer::BootTracer() {
+  // Nothing to initialize, static storage is already zeroed. Clearing the timestamps here would lose
+  // the milestones marked before the static constructors run
+}
+
+BootTracer::~BootTracer() {
+}
+
+void BootTracer::mark(BootMilestone milestone) {
+  uint64_t timestamp = now();
+#ifdef CONFIG_BOOT_TRACER_HISTORY
+  size_t index = 0;
+#endif // CONFIG_BOOT_TRACER_HISTORY
+
+  assert(milestone < BootMilestone::COUNT);
+
+  if (atomic_test_and_set_bit(reachedMilestones, (int)milestone)) {
+    return;
+  }
+  // 0 means not reached, a milestone can't be recorded at the very first cycle anyway
+  this->timestamps[(size_t)milestone] = MAX(timestamp, 1);
+
+#ifdef CONFIG_BOOT_TRACER_HISTORY
+  for (index = 0; index < BOOT_MILESTONE_COUNT; index++) {
+    if (!atomic_test_bit(reachedMilestones, (int)index)) {
+      return;
+    }
+  }
+  k_work_reschedule(&persistWork, K_NO_WAIT);
+#endif // CONFIG_BOOT_TRACER_HISTORY
+}
+
+uint64_t BootTracer::getCycles(BootMilestone milestone) {
+  assert(milestone < BootMilestone::COUNT);
+
+  return this->timestamps[(size_t)milestone];
+}
+
+const char *BootTracer::getName(BootMilestone milestone) {
+  assert(milestone < BootMilestone::COUNT);
+
+  return milestoneNames[(size_t)milestone];
+}
+
+uint64_t BootTracer::now() {
+  uint64_t ticks = k_uptime_ticks();
+  uint32_t cycles = k_cycle_get_32();
+  uint64_t coarse = k_ticks_to_cyc_floor64(ticks);
+  uint64_t precise = 0;
+
+  // The 32 bits cycle counter wraps after a few seconds, the uptime tells which wrap it is in
+  precise = (coarse & ~(uint64_t)UINT32_MAX) | cycles;
+  if (precise > (coarse + BIT64(31))) {
+    precise -= BIT64(32);
+  } else if ((precise + BIT64(31)) < coarse) {
+    precise += BIT64(32);
+  }
+
+  return precise;
+}
+
+#ifdef CONFIG_BOOT_TRACER_HISTORY
+int BootTracer::getHistory(boot_record_t *records, size_t count) {
+  ssize_t ret = 0;
+
+  assert(records);
+
+  count = MIN(count, (size_t)CONFIG_BOOT_TRACER_HISTORY_SIZE);
+  ret = Storage::getInstance().read(STORAGE_ID_BOOT_HISTORY, records, count * sizeof(boot_record_t));
+  if (ret == -ENOENT) {
+    return 0;
+  }
+  if (ret < 0) {
+    return (int)ret;
+  }
+
+  return (int)(MIN((size_t)ret, count * sizeof(boot_record_t)) / sizeof(boot_record_t));
+}
+
+void BootTracer::persist() {
+  int ret = 0;
+  int count = 0;
+  size_t index = 0;
+  static boot_record_t records[CONFIG_BOOT_TRACER_HISTORY_SIZE];
+
+  if (this->persisted) {
+    return;
+  }
+  this->persisted = true;
+
+  // Newest first, the oldest record falls off the end
+  count = this->getHistory(&records[1], ARRAY_SIZE(records) - 1);
+  if (count < 0) {
+    LOG_WRN("Failed to read the boot history (%d)", count);
+    count = 0;
+  }
+  records[0].bootNumber = (count > 0) ? (records[1].bootNumber + 1) : 1;
+  for (index = 0; index < BOOT_MILESTONE_COUNT; index++) {
+    records[0].milestoneUs[index] = (this->timestamps[index] == 0)
+                                    ? BOOT_MILESTONE_NOT_REACHED
+                                    : (uint32_t)k_cyc_to_us_floor64(this->timestamps[index]);
+  }
+
+  ret = Storage::getInstance().write(STORAGE_ID_BOOT_HISTORY, records, (count + 1) * sizeof(boot_record_t));
+  if (ret < 0) {
+    LOG_WRN("Failed to save the boot history (%d)", ret);
+  }
+}
+#endif // CONFIG_BOOT_TRACER_HISTORY
+
+static int shellBootTraceCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  size_t index = 0;
+  size_t next = 0;
+  uint64_t cycles = 0;
+  uint64_t previousUs = 0;
+  uint64_t timeUs = 0;
+  bool printed[BOOT_MILESTONE_COUNT] = {false};
+
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  // Milestones of different threads don't always happen in the same order, they are sorted by time
+  shell_print(shell, "%-20s %12s %12s", "Milestone", "Time (ms)", "Delta (ms)");
+  while (true) {
+    next = BOOT_MILESTONE_COUNT;
+    for (index = 0; index < BOOT_MILESTONE_COUNT; index++) {
+      cycles = BootTracer::getInstance().getCycles((BootMilestone)index);
+      if (!printed[index] && (cycles != 0) &&
+          ((next == BOOT_MILESTONE_COUNT) || (cycles < BootTracer::getInstance().getCycles((BootMilestone)next)))) {
+        next = index;
+      }
+    }
+    if (next == BOOT_MILESTONE_COUNT) {
+      break;
+    }
+    printed[next] = true;
+    timeUs = k_cyc_to_us_floor64(BootTracer::getInstance().getCycles((BootMilestone)next));
+    shell_print(shell, "%-20s %8lld.%03lld %8lld.%03lld",
+                BootTracer::getName((BootMilestone)next),
+                timeUs / USEC_PER_MSEC,
+                timeUs % USEC_PER_MSEC,
+                (timeUs - previousUs) / USEC_PER_MSEC,
+                (timeUs - previousUs) % USEC_PER_MSEC);
+    previousUs = timeUs;
+  }
+
+  for (index = 0; index < BOOT_MILESTONE_COUNT; index++) {
+    if (!printed[index]) {
+      shell_print(shell, "%-20s %12s", BootTracer::getName((BootMilestone)index), "-");
+    }
+  }
+
+  return 0;
+}
+
+#ifdef CONFIG_BOOT_TRACER_HISTORY
+static int shellBootHistoryCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  int count = 0;
+  int record = 0;
+  size_t index = 0;
+  static boot_record_t records[CONFIG_BOOT_TRACER_HISTORY_SIZE];
+
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  count = BootTracer::getInstance().getHistory(records, ARRAY_SIZE(records));
+  if (count < 0) {
+    shell_error(shell, "Failed to read the boot history (%d)", count);
+    return count;
+  }
+  if (count == 0) {
+    shell_print(shell, "No boot saved yet, the current one is saved once all milestones are reached");
+    return 0;
+  }
+
+  // One column per boot, newest first, in milliseconds
+  shell_fprintf(shell, SHELL_NORMAL, "%-20s", "Boot");
+  for (record = 0; record < count; record++) {
+    shell_fprintf(shell, SHELL_NORMAL, " %10d", records[record].bootNumber);
+  }
+  shell_print(shell, "");
+  for (index = 0; index < BOOT_MILESTONE_COUNT; index++) {
+    shell_fprintf(shell, SHELL_NORMAL, "%-20s", BootTracer::getName((BootMilestone)index));
+    for (record = 0; record < count; record++) {
+      if (records[record].milestoneUs[index] == BOOT_MILESTONE_NOT_REACHED) {
+        shell_fprintf(shell, SHELL_NORMAL, " %10s", "-");
+      } else {
+        shell_fprintf(shell, SHELL_NORMAL, " %6d.%03d",
+                      records[record].milestoneUs[index] / USEC_PER_MSEC,
+                      records[record].milestoneUs[index] % USEC_PER_MSEC);
+      }
+    }
+    shell_print(shell, "");
+  }
+
+  return 0;
+}
+#endif // CONFIG_BOOT_TRACER_HISTORY
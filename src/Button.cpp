@@ -1,18 +1,45 @@
 // Lib C
+#include <string.h>
+#include <errno.h>
 #include <assert.h>
 
 // Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
 #include <zephyr/drivers/gpio.h>
+#include <zephyr/shell/shell.h>
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(Button);
 
 // User C++ class headers
+#include "EventManager.h"
 #include "Button.h"
 
+static void buttonInterruptHandler(const struct device *port, struct gpio_callback *callback, gpio_port_pins_t pins);
+static void debounceWorkHandler(struct k_work *work);
+static void longPressWorkHandler(struct k_work *work);
+static int shellButtonCommandHandler(const struct shell *shell, size_t argc, char **argv);
+
+// Shell command registration
+SHELL_CMD_REGISTER(button, NULL, "Show button interrupt statistics", shellButtonCommandHandler);
+
+static button_stats_t buttonStats = {0};
+static int64_t buttonEventsStartTime = 0;
+
 Button::Button(const struct gpio_dt_spec *gpio) {
   assert(gpio);
 
   this->gpio = gpio;
+  this->polarity = ButtonPolarity::NORMAL;
+  this->eventsEnabled = false;
+  this->stateIsPressed = false;
+  this->edgePending = false;
+  this->longPressReported = false;
+  this->clickPending = false;
+  this->doubleClickReported = false;
+  this->edgeCycles = 0;
+  this->releaseTime = 0;
+  this->context.button = this;
 
   if (!gpio_is_ready_dt(gpio)) {
     LOG_ERR("Error: button device %s is not ready", gpio->port->name);
@@ -26,7 +53,15 @@ Button::Button(const struct gpio_dt_spec *gpio) {
 }
 
 Button::~Button() {
-  // Destructor is automatically called when the object goes out of scope or is explicitly deleted
+  struct k_work_sync sync;
+
+  // The interrupt and the pending work items must not reach a destroyed object
+  if (this->eventsEnabled) {
+    gpio_pin_interrupt_configure_dt(this->gpio, GPIO_INT_DISABLE);
+    gpio_remove_callback_dt(this->gpio, &this->context.callback);
+    k_work_cancel_delayable_sync(&this->context.debounceWork, &sync);
+    k_work_cancel_delayable_sync(&this->context.longPressWork, &sync);
+  }
 }
 
 bool Button::isPressed(ButtonPolarity polarity) {
@@ -40,3 +75,192 @@ bool Button::isPressed(ButtonPolarity polarity) {
 
   return result;
 }
+
+int Button::enableEvents(ButtonPolarity polarity) {
+  int ret = 0;
+
+  if (this->eventsEnabled) {
+    return -EALREADY;
+  }
+
+  this->polarity = polarity;
+  this->stateIsPressed = this->isPressed(polarity);
+  k_work_init_delayable(&this->context.debounceWork, debounceWorkHandler);
+  k_work_init_delayable(&this->context.longPressWork, longPressWorkHandler);
+
+  gpio_init_callback(&this->context.callback, buttonInterruptHandler, BIT(this->gpio->pin));
+  ret = gpio_add_callback_dt(this->gpio, &this->context.callback);
+  if (ret < 0) {
+    LOG_ERR("Error: Failed to add callback on %s pin %d (%d)", this->gpio->port->name, this->gpio->pin, ret);
+    return ret;
+  }
+
+  // Both edges, the debounce work decides whether the level really changed
+  ret = gpio_pin_interrupt_configure_dt(this->gpio, GPIO_INT_EDGE_BOTH);
+  if (ret < 0) {
+    LOG_ERR("Error: Failed to configure interrupt on %s pin %d (%d)", this->gpio->port->name, this->gpio->pin, ret);
+    gpio_remove_callback_dt(this->gpio, &this->context.callback);
+    return ret;
+  }
+
+  this->eventsEnabled = true;
+  if (buttonEventsStartTime == 0) {
+    buttonEventsStartTime = k_uptime_get();
+  }
+
+  return 0;
+}
+
+void Button::getStats(button_stats_t *stats) {
+  unsigned int key = 0;
+
+  assert(stats);
+
+  key = irq_lock();
+  memcpy(stats, &buttonStats, sizeof(*stats));
+  irq_unlock(key);
+}
+
+void Button::onEdge() {
+  buttonStats.interrupts++;
+  buttonStats.wakeups++;
+
+  // Latency is measured from the first edge of a bounce burst
+  if (!this->edgePending) {
+    this->edgePending = true;
+    this->edgeCycles = k_cycle_get_32();
+  }
+
+  // Every bounce pushes the sampling of the level back
+  k_work_reschedule(&this->context.debounceWork, K_MSEC(CONFIG_BUTTON_DEBOUNCE_MS));
+}
+
+void Button::debounce() {
+  bool pressed = false;
+  unsigned int key = 0;
+  uint32_t latencyUs = 0;
+
+  key = irq_lock();
+  buttonStats.wakeups++;
+  this->edgePending = false;
+  latencyUs = k_cyc_to_us_floor32(k_cycle_get_32() - this->edgeCycles);
+  irq_unlock(key);
+
+  // Glitch shorter than the debounce time, nothing changed
+  pressed = this->isPressed(this->polarity);
+  if (pressed == this->stateIsPressed) {
+    return;
+  }
+  this->stateIsPressed = pressed;
+
+  if (pressed) {
+    key = irq_lock();
+    buttonStats.presses++;
+    buttonStats.lastLatencyUs = latencyUs;
+    buttonStats.maxLatencyUs = MAX(buttonStats.maxLatencyUs, latencyUs);
+    buttonStats.totalLatencyUs += latencyUs;
+    irq_unlock(key);
+    LOG_INF("Button is pressed (%d us after the edge)", latencyUs);
+
+    this->publish(EVENT_BUTTON_PRESSED, latencyUs);
+    this->doubleClickReported = this->clickPending &&
+                                ((k_uptime_get() - this->releaseTime) <= CONFIG_BUTTON_DOUBLE_CLICK_MS);
+    this->clickPending = false;
+    if (this->doubleClickReported) {
+      this->publish(EVENT_BUTTON_DOUBLE_CLICKED, latencyUs);
+    }
+    this->longPressReported = false;
+    k_work_reschedule(&this->context.longPressWork, K_MSEC(CONFIG_BUTTON_LONG_PRESS_MS));
+  } else {
+    k_work_cancel_delayable(&this->context.longPressWork);
+    this->publish(EVENT_BUTTON_RELEASED, latencyUs);
+
+    // Only a short click can be the first half of a double click, a third click starts a new one
+    this->clickPending = !this->longPressReported && !this->doubleClickReported;
+    this->releaseTime = k_uptime_get();
+  }
+}
+
+void Button::longPress() {
+  unsigned int key = 0;
+
+  key = irq_lock();
+  buttonStats.wakeups++;
+  irq_unlock(key);
+
+  if (this->stateIsPressed) {
+    this->longPressReported = true;
+    this->publish(EVENT_BUTTON_LONG_PRESSED, 0);
+  }
+}
+
+void Button::publish(event_id_t id, uint32_t latencyUs) {
+  int ret = 0;
+  unsigned int key = 0;
+  button_event_t eventToPublish = {.id = id, .latencyUs = latencyUs};
+
+  // Called from the system workqueue, which must not wait for a busy channel
+  ret = publishEvent(&eventToPublish, K_NO_WAIT);
+  if (ret < 0) {
+    key = irq_lock();
+    buttonStats.failed++;
+    irq_unlock(key);
+    LOG_WRN("Failed to publish button event %d (%d)", id, ret);
+    return;
+  }
+
+  key = irq_lock();
+  buttonStats.events++;
+  irq_unlock(key);
+}
+
+static void buttonInterruptHandler(const struct device *port, struct gpio_callback *callback, gpio_port_pins_t pins) {
+  button_context_t *context = CONTAINER_OF(callback, button_context_t, callback);
+
+  ARG_UNUSED(port);
+  ARG_UNUSED(pins);
+
+  context->button->onEdge();
+}
+
+static void debounceWorkHandler(struct k_work *work) {
+  struct k_work_delayable *delayable = k_work_delayable_from_work(work);
+  button_context_t *context = CONTAINER_OF(delayable, button_context_t, debounceWork);
+
+  context->button->debounce();
+}
+
+static void longPressWorkHandler(struct k_work *work) {
+  struct k_work_delayable *delayable = k_work_delayable_from_work(work);
+  button_context_t *context = CONTAINER_OF(delayable, button_context_t, longPressWork);
+
+  context->button->longPress();
+}
+
+static int shellButtonCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  button_stats_t stats = {0};
+  uint32_t elapsedMs = 0;
+
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  if (buttonEventsStartTime == 0) {
+    shell_print(shell, "No button in interrupt mode");
+    return 0;
+  }
+
+  Button::getStats(&stats);
+  elapsedMs = MAX((uint32_t)(k_uptime_get() - buttonEventsStartTime), 1);
+
+  shell_print(shell, "Interrupts:        %d", stats.interrupts);
+  shell_print(shell, "Events published:  %d", stats.events);
+  shell_print(shell, "Events failed:     %d", stats.failed);
+  shell_print(shell, "Press latency:     last %d us, max %d us, average %d us",
+              stats.lastLatencyUs,
+              stats.maxLatencyUs,
+              stats.presses ? (uint32_t)(stats.totalLatencyUs / stats.presses) : 0);
+  shell_print(shell, "Wakeups per hour:  %d (polling every 300 ms: 12000)",
+              (uint32_t)(((uint64_t)stats.wakeups * 3600 * MSEC_PER_SEC) / elapsedMs));
+
+  return 0;
+}
@@ -0,0 +1,342 @@
+// Lib C
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(DeltaPatcher);
+
+// User C++ class headers
+#include "DeltaPatcher.h"
+
+DeltaPatcher::DeltaPatcher(uint8_t sourcePartitionId) {
+  this->sourceSize = 0;
+  this->targetSize = 0;
+  this->bytesWritten = 0;
+  this->sourcePartitionId = sourcePartitionId;
+  this->sourceArea = NULL;
+  this->state = DeltaPatcherState::FAILED;
+  this->headerLength = 0;
+  this->operation = 0;
+  this->operationShift = 0;
+  this->dataLeft = 0;
+  this->sourceOffset = 0;
+  memset(this->header, 0x00, sizeof(this->header));
+  memset(this->sourceHash, 0x00, sizeof(this->sourceHash));
+  memset(this->targetHash, 0x00, sizeof(this->targetHash));
+  mbedtls_sha256_init(&this->targetContext);
+}
+
+DeltaPatcher::~DeltaPatcher() {
+  if (this->sourceArea) {
+    flash_area_close(this->sourceArea);
+  }
+  mbedtls_sha256_free(&this->targetContext);
+}
+
+int DeltaPatcher::start(InplaceFunction<int(const uint8_t *, size_t, bool)> writer) {
+  int ret = 0;
+
+  assert(writer);
+
+  if (!this->sourceArea) {
+    ret = flash_area_open(this->sourcePartitionId, &this->sourceArea);
+    if (ret < 0) {
+      LOG_ERR("Failed to open source partition %d (%d)", this->sourcePartitionId, ret);
+      this->sourceArea = NULL;
+      return ret;
+    }
+  }
+
+  this->writer = writer;
+  this->state = DeltaPatcherState::HEADER;
+  this->sourceSize = 0;
+  this->targetSize = 0;
+  this->bytesWritten = 0;
+  this->headerLength = 0;
+  this->operation = 0;
+  this->operationShift = 0;
+  this->dataLeft = 0;
+  this->sourceOffset = 0;
+  mbedtls_sha256_starts(&this->targetContext, 0);
+
+  return 0;
+}
+
+int DeltaPatcher::write(const uint8_t *data, size_t length) {
+  int ret = 0;
+  size_t used = 0;
+
+  assert(data || (length == 0));
+
+  while (length > 0) {
+    switch (this->state) {
+    case DeltaPatcherState::HEADER:
+      used = MIN(length, DELTA_PATCH_HEADER_SIZE - this->headerLength);
+      memcpy(&this->header[this->headerLength], data, used);
+      this->headerLength += used;
+      if (this->headerLength == DELTA_PATCH_HEADER_SIZE) {
+        ret = this->parseHeader();
+      }
+      break;
+    case DeltaPatcherState::OPERATION:
+      // Varints are decoded a byte at a time, they can be split across fragments
+      used = 1;
+      this->operation |= (uint64_t)(data[0] & 0x7F) << this->operationShift;
+      if ((data[0] & 0x80) == 0) {
+        ret = this->parseOperation();
+      } else {
+        this->operationShift += 7;
+        if (this->operationShift > DELTA_PATCH_VARINT_MAX_SHIFT) {
+          LOG_ERR("Invalid patch operation");
+          ret = -EINVAL;
+        }
+      }
+      break;
+    case DeltaPatcherState::ADD:
+      used = MIN(length, this->dataLeft);
+      ret = this->add(data, used);
+      break;
+    case DeltaPatcherState::INSERT:
+      used = MIN(length, this->dataLeft);
+      ret = this->emit(data, used);
+      this->dataLeft -= used;
+      if (this->dataLeft == 0) {
+        this->endOperation();
+      }
+      break;
+    case DeltaPatcherState::DONE:
+      LOG_ERR("Patch continues past the end of the image");
+      ret = -EINVAL;
+      break;
+    default:
+      ret = -EIO;
+      break;
+    }
+
+    if (ret < 0) {
+      this->state = DeltaPatcherState::FAILED;
+      return ret;
+    }
+    data += used;
+    length -= used;
+  }
+
+  return 0;
+}
+
+int DeltaPatcher::finish() {
+  int ret = 0;
+  uint8_t hash[DELTA_PATCH_HASH_SIZE] = {0};
+
+  if (this->state != DeltaPatcherState::DONE) {
+    LOG_ERR("Patch is incomplete, %d of %d bytes rebuilt", this->bytesWritten, this->targetSize);
+    return -EIO;
+  }
+
+  ret = this->writer(this->buffer, 0, true);
+  if (ret < 0) {
+    return ret;
+  }
+
+  // The rebuilt image was hashed as it was written, nothing has to be read back
+  mbedtls_sha256_finish(&this->targetContext, hash);
+  if (memcmp(hash, this->targetHash, sizeof(hash)) != 0) {
+    LOG_ERR("SHA-256 of the rebuilt image doesn't match the patch");
+    return -EBADMSG;
+  }
+
+  return 0;
+}
+
+int DeltaPatcher::parseHeader() {
+  int ret = 0;
+
+  if (sys_get_le32(&this->header[0]) != DELTA_PATCH_MAGIC) {
+    LOG_ERR("Not a delta patch");
+    return -EINVAL;
+  }
+  this->sourceSize = sys_get_le32(&this->header[4]);
+  this->targetSize = sys_get_le32(&this->header[8]);
+  memcpy(this->sourceHash, &this->header[12], DELTA_PATCH_HASH_SIZE);
+  memcpy(this->targetHash, &this->header[12 + DELTA_PATCH_HASH_SIZE], DELTA_PATCH_HASH_SIZE);
+
+  if (this->sourceSize > this->sourceArea->fa_size) {
+    LOG_ERR("Patch source is larger than the source partition");
+    return -EINVAL;
+  }
+
+  // Nothing has been written yet, a patch made for another image is rejected before slot1 is touched
+  ret = this->checkSource();
+  if (ret < 0) {
+    return ret;
+  }
+  LOG_INF("Rebuilding a %d bytes image from a %d bytes one", this->targetSize, this->sourceSize);
+
+  this->endOperation();
+
+  return 0;
+}
+
+int DeltaPatcher::parseOperation() {
+  int ret = 0;
+  uint64_t argument = this->operation >> 2;
+  int64_t seek = 0;
+
+  switch ((DeltaPatchOperation)(this->operation & 0x03)) {
+  case DeltaPatchOperation::COPY:
+    if ((argument > (this->targetSize - this->bytesWritten)) ||
+        (argument > (this->sourceSize - this->sourceOffset))) {
+      LOG_ERR("Patch operation goes past the end of the images");
+      return -EINVAL;
+    }
+    ret = this->copy((uint32_t)argument);
+    this->endOperation();
+    break;
+  case DeltaPatchOperation::ADD:
+    if ((argument > (this->targetSize - this->bytesWritten)) ||
+        (argument > (this->sourceSize - this->sourceOffset))) {
+      LOG_ERR("Patch operation goes past the end of the images");
+      return -EINVAL;
+    }
+    this->dataLeft = (uint32_t)argument;
+    this->state = DeltaPatcherState::ADD;
+    break;
+  case DeltaPatchOperation::INSERT:
+    if (argument > (this->targetSize - this->bytesWritten)) {
+      LOG_ERR("Patch operation goes past the end of the image");
+      return -EINVAL;
+    }
+    this->dataLeft = (uint32_t)argument;
+    this->state = DeltaPatcherState::INSERT;
+    break;
+  case DeltaPatchOperation::SEEK:
+    // Zigzag encoding, odd values are negative
+    seek = (argument & 1) ? -(int64_t)((argument + 1) >> 1) : (int64_t)(argument >> 1);
+    if (((this->sourceOffset + seek) < 0) || ((this->sourceOffset + seek) > this->sourceSize)) {
+      LOG_ERR("Patch seeks outside of the source");
+      return -EINVAL;
+    }
+    this->sourceOffset += seek;
+    this->endOperation();
+    break;
+  }
+
+  // Empty ADD and INSERT operations have no data to wait for
+  if (((this->state == DeltaPatcherState::ADD) || (this->state == DeltaPatcherState::INSERT)) &&
+      (this->dataLeft == 0)) {
+    this->endOperation();
+  }
+
+  return ret;
+}
+
+int DeltaPatcher::copy(uint32_t length) {
+  int ret = 0;
+  size_t chunk = 0;
+
+  while (length > 0) {
+    chunk = MIN(length, sizeof(this->buffer));
+    ret = flash_area_read(this->sourceArea, this->sourceOffset, this->buffer, chunk);
+    if (ret < 0) {
+      LOG_ERR("Failed to read the source at %d (%d)", this->sourceOffset, ret);
+      return ret;
+    }
+    ret = this->emit(this->buffer, chunk);
+    if (ret < 0) {
+      return ret;
+    }
+    this->sourceOffset += chunk;
+    length -= chunk;
+  }
+
+  return 0;
+}
+
+int DeltaPatcher::add(const uint8_t *data, size_t length) {
+  int ret = 0;
+  size_t chunk = 0;
+  size_t index = 0;
+
+  while (length > 0) {
+    chunk = MIN(length, sizeof(this->buffer));
+    ret = flash_area_read(this->sourceArea, this->sourceOffset, this->buffer, chunk);
+    if (ret < 0) {
+      LOG_ERR("Failed to read the source at %d (%d)", this->sourceOffset, ret);
+      return ret;
+    }
+    for (index = 0; index < chunk; index++) {
+      this->buffer[index] += data[index];
+    }
+
+    ret = this->emit(this->buffer, chunk);
+    if (ret < 0) {
+      return ret;
+    }
+    this->sourceOffset += chunk;
+    this->dataLeft -= chunk;
+    data += chunk;
+    length -= chunk;
+  }
+
+  if (this->dataLeft == 0) {
+    this->endOperation();
+  }
+
+  return 0;
+}
+
+int DeltaPatcher::emit(const uint8_t *data, size_t length) {
+  int ret = 0;
+
+  mbedtls_sha256_update(&this->targetContext, data, length);
+  ret = this->writer(data, length, false);
+  if (ret < 0) {
+    return ret;
+  }
+  this->bytesWritten += length;
+
+  return 0;
+}
+
+void DeltaPatcher::endOperation() {
+  this->operation = 0;
+  this->operationShift = 0;
+  this->dataLeft = 0;
+  this->state = (this->bytesWritten >= this->targetSize) ? DeltaPatcherState::DONE
+                                                          : DeltaPatcherState::OPERATION;
+}
+
+int DeltaPatcher::checkSource() {
+  int ret = 0;
+  uint32_t offset = 0;
+  size_t chunk = 0;
+  uint8_t hash[DELTA_PATCH_HASH_SIZE] = {0};
+  mbedtls_sha256_context sourceContext;
+
+  mbedtls_sha256_init(&sourceContext);
+  mbedtls_sha256_starts(&sourceContext, 0);
+  for (offset = 0; offset < this->sourceSize; offset += chunk) {
+    chunk = MIN(this->sourceSize - offset, sizeof(this->buffer));
+    ret = flash_area_read(this->sourceArea, offset, this->buffer, chunk);
+    if (ret < 0) {
+      mbedtls_sha256_free(&sourceContext);
+      return ret;
+    }
+    mbedtls_sha256_update(&sourceContext, this->buffer, chunk);
+  }
+  mbedtls_sha256_finish(&sourceContext, hash);
+  mbedtls_sha256_free(&sourceContext);
+
+  if (memcmp(hash, this->sourceHash, sizeof(hash)) != 0) {
+    LOG_ERR("Patch was not made for the running image");
+    return -ESTALE;
+  }
+
+  return 0;
+}
@@ -1,90 +1,483 @@
 // Lib C
+#include <string.h>
+#include <errno.h>
 #include <assert.h>
 
 // Zephyr includes
+#include <zephyr/sys/atomic.h>
 #include <zephyr/zbus/zbus.h>
+#include <zephyr/shell/shell.h>
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(EventManager);
 
 // User C++ class headers
 #include "EventManager.h"
 
-// ZBUS channel definition
+// Publish counters of each channel, kept as the channel user data
+typedef struct {
+  atomic_t published;
+  atomic_t failed;
+} channel_counters_t;
+
+static channel_counters_t networkChannelCounters = {ATOMIC_INIT(0), ATOMIC_INIT(0)};
+static channel_counters_t buttonChannelCounters = {ATOMIC_INIT(0), ATOMIC_INIT(0)};
+static channel_counters_t otaChannelCounters = {ATOMIC_INIT(0), ATOMIC_INIT(0)};
+
+// ZBUS channels definition, one per event family
 ZBUS_CHAN_DEFINE(
-  eventsChannel,                           // Channel name
-  event_t,                                 // Message type
+  networkChannel,                          // Channel name
+  network_event_t,                         // Message type
   NULL,                                    // Validator function
-  NULL,                                    // User data
+  &networkChannelCounters,                 // User data
   ZBUS_OBSERVERS(ZBUS_OBSERVERS_EMPTY),    // Initial observers list
   ZBUS_MSG_INIT(.id = EVENT_INITIAL_VALUE) // Message initialization
 );
 
-int waitForEvent(const zbus_observer *subscriber, event_t *event, k_timeout_t timeout) {
+ZBUS_CHAN_DEFINE(
+  buttonChannel,                           // Channel name
+  button_event_t,                          // Message type
+  NULL,                                    // Validator function
+  &buttonChannelCounters,                  // User data
+  ZBUS_OBSERVERS(ZBUS_OBSERVERS_EMPTY),    // Initial observers list
+  ZBUS_MSG_INIT(.id = EVENT_INITIAL_VALUE) // Message initialization
+);
+
+ZBUS_CHAN_DEFINE(
+  otaChannel,                              // Channel name
+  ota_event_t,                             // Message type
+  NULL,                                    // Validator function
+  &otaChannelCounters,                     // User data
+  ZBUS_OBSERVERS(ZBUS_OBSERVERS_EMPTY),    // Initial observers list
+  ZBUS_MSG_INIT(.id = EVENT_INITIAL_VALUE) // Message initialization
+);
+
+static int shellEventsStatsCommandHandler(const struct shell *shell, size_t argc, char **argv);
+static int shellEventsQueuesCommandHandler(const struct shell *shell, size_t argc, char **argv);
+#ifdef CONFIG_EVENT_MANAGER_BENCHMARK
+static int shellEventsBenchCommandHandler(const struct shell *shell, size_t argc, char **argv);
+#endif // CONFIG_EVENT_MANAGER_BENCHMARK
+
+// Shell command registration
+#ifdef CONFIG_EVENT_MANAGER_BENCHMARK
+SHELL_STATIC_SUBCMD_SET_CREATE(
+  eventsSubcommands,
+  SHELL_CMD(stats, NULL, "Show published events and observer wakeups", shellEventsStatsCommandHandler),
+  SHELL_CMD(queues, NULL, "Show event queues back-pressure", shellEventsQueuesCommandHandler),
+  SHELL_CMD(bench, NULL, "Measure event dispatch cycles for 4, 32 and 128 event types", shellEventsBenchCommandHandler),
+  SHELL_SUBCMD_SET_END
+);
+#else
+SHELL_STATIC_SUBCMD_SET_CREATE(
+  eventsSubcommands,
+  SHELL_CMD(stats, NULL, "Show published events and observer wakeups", shellEventsStatsCommandHandler),
+  SHELL_CMD(queues, NULL, "Show event queues back-pressure", shellEventsQueuesCommandHandler),
+  SHELL_SUBCMD_SET_END
+);
+#endif // CONFIG_EVENT_MANAGER_BENCHMARK
+SHELL_CMD_REGISTER(events, &eventsSubcommands, "Event manager commands", NULL);
+
+static atomic_t publishedEvents = ATOMIC_INIT(0);
+static atomic_t failedEvents = ATOMIC_INIT(0);
+static atomic_t observerWakeups = ATOMIC_INIT(0);
+
+#ifdef CONFIG_EVENT_MANAGER_BENCHMARK
+static constexpr uint32_t EVENT_BENCHMARK_EVENTS = 4096;
+
+// Benchmark ids are plain integers so that more event types than event_id_t holds can be used
+typedef struct {
+  uint32_t id;
+  event_action_t action;
+} benchmark_pair_t;
+
+template <size_t COUNT>
+struct benchmark_list_t {
+  benchmark_pair_t pairs[COUNT];
+};
+
+static volatile uint32_t benchmarkActionCount = 0;
+#endif // CONFIG_EVENT_MANAGER_BENCHMARK
+
+int waitForEvent(const zbus_observer *subscriber, event_message_t *message, k_timeout_t timeout) {
   int ret = 0;
   const struct zbus_channel *channel = NULL;
+  k_timepoint_t deadline = sys_timepoint_calc(timeout);
 
   assert(subscriber);
-  assert(event);
+  assert(message);
 
-  // Wait forever for an event
-  ret = zbus_sub_wait(subscriber, &channel, K_FOREVER);
+  // Wait for an event, only the channels the subscriber observes can wake it up
+  ret = zbus_sub_wait(subscriber, &channel, timeout);
 
   // Check if notification is received
   if (ret == 0) {
+    atomic_inc(&observerWakeups);
 
-    // Make sure the event came on the right channel
-    if (&eventsChannel == channel) {
+    // Make sure the payload fits, all the event channels do
+    if (zbus_chan_msg_size(channel) <= sizeof(*message)) {
 
-      // Read the event
-      ret = zbus_chan_read(&eventsChannel, event, K_FOREVER);
+      // Read the event within what is left of the timeout
+      ret = zbus_chan_read(channel, message, sys_timepoint_timeout(deadline));
 
       if (ret == 0) {
         LOG_DBG("Subscriber <%s> received event <%d> on <%s>\r\n",
                 subscriber->name,
-                event->id,
+                message->event.id,
                 channel->name);
       } else {
         // Something wrong happened while reading event from channel
         LOG_ERR("Something wrong happened while reading from channel: %d", ret);
       }
     } else {
-      // I'm not interested in this channel
+      // Not an event channel
       LOG_WRN("<%s> is not interested in this channel: <%s>", subscriber->name, channel->name);
+      ret = -EINVAL;
     }
-  } else {
-    // Something wrong happened while waiting for event
+  } else if ((ret != -EAGAIN) && (ret != -ENOMSG)) {
+    // Something wrong happened while waiting for event, running out of time is expected
     LOG_ERR("Something wrong happened while waiting for event: %d", ret);
   }
 
   return ret;
 }
 
-void processEvent(event_t *event, const event_action_pair_t *eventActionList, uint8_t listLength) {
-  uint8_t eventIndex = 0;
+int waitForEvent(EventQueue *queue, event_message_t *message, k_timeout_t timeout) {
+  int ret = 0;
+
+  assert(queue);
+  assert(message);
 
-  assert(event);
-  assert(eventActionList);
-  assert(listLength);
+  ret = queue->pop(message, timeout);
+  if (ret == 0) {
+    atomic_inc(&observerWakeups);
+  }
 
-  // For each event/action pair
-  for (eventIndex = 0; eventIndex < listLength; eventIndex++) {
-    // If the event that needs to be processed is found
-    if (event->id == eventActionList[eventIndex].id) {
-      // And has a valid action function
-      if (eventActionList[eventIndex].action) {
-        // Execute its associated action
-        eventActionList[eventIndex].action();
-      }
+  return ret;
+}
+
+int waitForEvents(EventQueue *queue, event_message_t *messages, size_t maxCount, k_timeout_t timeout) {
+  int ret = 0;
+  size_t count = 0;
+
+  assert(queue);
+  assert(messages);
+  assert(maxCount);
+
+  // Block for the first event only, then take what is already pending
+  ret = queue->pop(&messages[0], timeout);
+  if (ret < 0) {
+    return ret;
+  }
+  for (count = 1; count < maxCount; count++) {
+    if (queue->pop(&messages[count], K_NO_WAIT) < 0) {
+      break;
     }
   }
+  atomic_inc(&observerWakeups);
+
+  return (int)count;
 }
 
-int publishEvent(event_t *event, k_timeout_t timeout) {
+int publishOnChannel(const struct zbus_channel *channel, const void *message, k_timeout_t timeout) {
   int ret = 0;
+  channel_counters_t *counters = NULL;
 
-  assert(event);
+  assert(channel);
+  assert(message);
 
-  ret = zbus_chan_pub(&eventsChannel, event, timeout);
+  counters = static_cast<channel_counters_t *>(zbus_chan_user_data(channel));
+
+  ret = zbus_chan_pub(channel, message, timeout);
+  if (ret == 0) {
+    atomic_inc(&publishedEvents);
+    atomic_inc(&counters->published);
+  } else {
+    // The channel stayed busy, the event is lost for every observer
+    atomic_inc(&failedEvents);
+    atomic_inc(&counters->failed);
+    LOG_WRN("Failed to publish event <%d> on <%s>: %d",
+            ((const event_t *)message)->id,
+            channel->name,
+            ret);
+  }
 
   return ret;
-}
\ No newline at end of file
+}
+
+const void *readOnChannel(const struct zbus_channel *channel, const struct zbus_channel *expected) {
+  assert(channel);
+  assert(expected);
+
+  // Listeners run in the publisher context while the channel is locked, the message can be used as is
+  atomic_inc(&observerWakeups);
+  if (channel != expected) {
+    return NULL;
+  }
+
+  return zbus_chan_const_msg(channel);
+}
+
+void getChannelStats(const struct zbus_channel *channel, event_channel_stats_t *stats) {
+  channel_counters_t *counters = NULL;
+
+  assert(channel);
+  assert(stats);
+
+  counters = static_cast<channel_counters_t *>(zbus_chan_user_data(channel));
+  stats->published = (uint32_t)atomic_get(&counters->published);
+  stats->failed = (uint32_t)atomic_get(&counters->failed);
+}
+
+void getEventStats(event_stats_t *stats) {
+  assert(stats);
+
+  stats->published = (uint32_t)atomic_get(&publishedEvents);
+  stats->failed = (uint32_t)atomic_get(&failedEvents);
+  stats->wakeups = (uint32_t)atomic_get(&observerWakeups);
+}
+
+sys_slist_t EventQueue::queues;
+
+EventQueue::EventQueue(const char *name, event_queue_cell_t *cells, uint32_t size) {
+  uint32_t index = 0;
+
+  assert(name);
+  assert(cells);
+  assert(IS_POWER_OF_TWO(size));
+
+  this->name = name;
+  this->cells = cells;
+  this->size = size;
+  this->received = 0;
+  this->maxLatencyUs = 0;
+  this->totalLatencyUs = 0;
+  atomic_set(&this->head, 0);
+  atomic_set(&this->tail, 0);
+  atomic_set(&this->highWater, 0);
+  atomic_set(&this->drops, 0);
+  k_sem_init(&this->available, 0, size);
+
+  // A cell is free for the position equal to its sequence
+  for (index = 0; index < size; index++) {
+    atomic_set(&this->cells[index].sequence, (atomic_val_t)index);
+  }
+
+  sys_slist_append(&EventQueue::queues, &this->node);
+}
+
+EventQueue::~EventQueue() {
+  sys_slist_find_and_remove(&EventQueue::queues, &this->node);
+}
+
+bool EventQueue::push(const struct zbus_channel *channel) {
+  size_t messageSize = 0;
+  atomic_val_t position = 0;
+  atomic_val_t sequence = 0;
+  atomic_val_t used = 0;
+  atomic_val_t highWater = 0;
+  event_queue_cell_t *cell = NULL;
+
+  assert(channel);
+
+  messageSize = zbus_chan_msg_size(channel);
+  if (messageSize > sizeof(cell->message)) {
+    return false;
+  }
+
+  // Claim the cell at the tail, several publishers can race for it
+  position = atomic_get(&this->tail);
+  while (true) {
+    cell = &this->cells[(uint32_t)position & (this->size - 1)];
+    sequence = atomic_get(&cell->sequence);
+    if (sequence == position) {
+      if (atomic_cas(&this->tail, position, position + 1)) {
+        break;
+      }
+      position = atomic_get(&this->tail);
+    } else if ((int32_t)((uint32_t)sequence - (uint32_t)position) < 0) {
+      // The consumer hasn't released this cell yet, the ring is full
+      atomic_inc(&this->drops);
+      return false;
+    } else {
+      // Another publisher took this position
+      position = atomic_get(&this->tail);
+    }
+  }
+
+  // Listeners run while the channel is locked, its message can be copied as is
+  cell->timestamp = k_cycle_get_32();
+  memcpy(&cell->message, zbus_chan_const_msg(channel), messageSize);
+  atomic_set(&cell->sequence, position + 1);
+
+  used = position + 1 - atomic_get(&this->head);
+  highWater = atomic_get(&this->highWater);
+  while ((used > highWater) && !atomic_cas(&this->highWater, highWater, used)) {
+    highWater = atomic_get(&this->highWater);
+  }
+
+  k_sem_give(&this->available);
+
+  return true;
+}
+
+int EventQueue::pop(event_message_t *message, k_timeout_t timeout) {
+  int ret = 0;
+  atomic_val_t position = 0;
+  uint32_t latencyUs = 0;
+  event_queue_cell_t *cell = NULL;
+
+  assert(message);
+
+  ret = k_sem_take(&this->available, timeout);
+  if (ret < 0) {
+    return ret;
+  }
+
+  position = atomic_get(&this->head);
+  cell = &this->cells[(uint32_t)position & (this->size - 1)];
+
+  // A publisher that claimed this cell before the one that gave the semaphore can still be
+  // copying its event, let it finish
+  while (atomic_get(&cell->sequence) != (position + 1)) {
+    k_sleep(K_TICKS(1));
+  }
+
+  memcpy(message, &cell->message, sizeof(*message));
+  latencyUs = k_cyc_to_us_floor32(k_cycle_get_32() - cell->timestamp);
+
+  // Release the cell for the position one lap ahead
+  atomic_set(&cell->sequence, position + (atomic_val_t)this->size);
+  atomic_set(&this->head, position + 1);
+
+  this->received++;
+  this->totalLatencyUs += latencyUs;
+  this->maxLatencyUs = MAX(this->maxLatencyUs, latencyUs);
+
+  return 0;
+}
+
+void EventQueue::getStats(event_queue_stats_t *stats) {
+  assert(stats);
+
+  stats->name = this->name;
+  stats->size = this->size;
+  stats->pending = k_sem_count_get(&this->available);
+  stats->highWater = (uint32_t)atomic_get(&this->highWater);
+  stats->drops = (uint32_t)atomic_get(&this->drops);
+  stats->received = this->received;
+  stats->maxLatencyUs = this->maxLatencyUs;
+  stats->averageLatencyUs = this->received ? (uint32_t)(this->totalLatencyUs / this->received) : 0;
+}
+
+static int shellEventsStatsCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  event_stats_t stats = {0};
+
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  getEventStats(&stats);
+
+  shell_print(shell, "Events published:   %d (%d failed)", stats.published, stats.failed);
+  shell_print(shell, "Observer wakeups:   %d", stats.wakeups);
+  shell_print(shell, "Wakeups per event:  %d.%02d",
+              stats.published ? (stats.wakeups / stats.published) : 0,
+              stats.published ? ((stats.wakeups * 100 / stats.published) % 100) : 0);
+
+  return 0;
+}
+
+static int shellEventsQueuesCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  EventQueue *queue = NULL;
+  event_queue_stats_t stats = {0};
+
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  shell_print(shell, "%-16s %5s %8s %10s %6s %9s %14s %14s",
+              "Queue", "Size", "Pending", "High water", "Drops", "Received", "Max latency", "Avg latency");
+  SYS_SLIST_FOR_EACH_CONTAINER(&EventQueue::queues, queue, node) {
+    queue->getStats(&stats);
+    shell_print(shell, "%-16s %5d %8d %10d %6d %9d %11d us %11d us",
+                stats.name,
+                stats.size,
+                stats.pending,
+                stats.highWater,
+                stats.drops,
+                stats.received,
+                stats.maxLatencyUs,
+                stats.averageLatencyUs);
+  }
+
+  return 0;
+}
+
+#ifdef CONFIG_EVENT_MANAGER_BENCHMARK
+static void benchmarkAction(const event_message_t *message) {
+  ARG_UNUSED(message);
+
+  benchmarkActionCount++;
+}
+
+template <size_t COUNT>
+static constexpr benchmark_list_t<COUNT> makeBenchmarkList() {
+  size_t index = 0;
+  benchmark_list_t<COUNT> list = {};
+
+  for (index = 0; index < COUNT; index++) {
+    list.pairs[index].id = index + 1;
+    list.pairs[index].action = benchmarkAction;
+  }
+
+  return list;
+}
+
+template <size_t COUNT>
+static void benchmarkDispatch(const struct shell *shell) {
+  static constexpr benchmark_list_t<COUNT> list = makeBenchmarkList<COUNT>();
+  static constexpr EventDispatchTable<COUNT, COUNT + 1> dispatchTable(list.pairs);
+  uint32_t event = 0;
+  uint32_t index = 0;
+  uint32_t id = 0;
+  uint32_t start = 0;
+  uint32_t scanCycles = 0;
+  uint32_t tableCycles = 0;
+
+  // Events cycle through all the ids, the loop overhead is the same for both methods
+  k_sched_lock();
+
+  start = k_cycle_get_32();
+  for (event = 0; event < EVENT_BENCHMARK_EVENTS; event++) {
+    id = (event % COUNT) + 1;
+    for (index = 0; index < COUNT; index++) {
+      if (list.pairs[index].id == id) {
+        list.pairs[index].action(NULL);
+      }
+    }
+  }
+  scanCycles = k_cycle_get_32() - start;
+
+  start = k_cycle_get_32();
+  for (event = 0; event < EVENT_BENCHMARK_EVENTS; event++) {
+    id = (event % COUNT) + 1;
+    dispatchTable.dispatch(id, NULL);
+  }
+  tableCycles = k_cycle_get_32() - start;
+
+  k_sched_unlock();
+
+  shell_print(shell, "%3d event types: linear scan %5d cycles/event, dispatch table %5d cycles/event",
+              COUNT,
+              scanCycles / EVENT_BENCHMARK_EVENTS,
+              tableCycles / EVENT_BENCHMARK_EVENTS);
+}
+
+static int shellEventsBenchCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  benchmarkDispatch<4>(shell);
+  benchmarkDispatch<32>(shell);
+  benchmarkDispatch<128>(shell);
+
+  return 0;
+}
+#endif // CONFIG_EVENT_MANAGER_BENCHMARK
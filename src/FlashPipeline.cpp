@@ -0,0 +1,215 @@
+// Lib C
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(FlashPipeline);
+
+// User C++ class headers
+#include "FlashPipeline.h"
+
+static constexpr uint32_t FLASH_PIPELINE_SLOT_SIZE = CONFIG_UPDATER_PIPELINE_SLOT_SIZE;
+static constexpr uint32_t FLASH_PIPELINE_SLOT_COUNT = CONFIG_UPDATER_PIPELINE_SLOT_COUNT;
+
+typedef struct {
+  uint32_t slot;
+  uint32_t offset;
+  uint32_t length;
+  bool flush;
+} slot_descriptor_t;
+
+static void flashWriterThreadHandler();
+
+// Filled slots waiting to be written, and free slots the producer can fill
+K_MSGQ_DEFINE(filledSlots, sizeof(slot_descriptor_t), FLASH_PIPELINE_SLOT_COUNT, 4);
+K_SEM_DEFINE(freeSlots, FLASH_PIPELINE_SLOT_COUNT, FLASH_PIPELINE_SLOT_COUNT);
+
+// Same priority as the updater thread so that both get the CPU while the other one is blocked
+K_THREAD_DEFINE(flashWriterThread, CONFIG_UPDATER_FLASH_PIPELINE_STACK_SIZE, flashWriterThreadHandler, NULL, NULL, NULL,
+                7, 0, 0);
+
+static uint8_t slotBuffers[FLASH_PIPELINE_SLOT_COUNT][FLASH_PIPELINE_SLOT_SIZE];
+static uint32_t nextSlot = 0;
+static InplaceFunction<int(const uint8_t *, size_t, bool)> writerFunction;
+static atomic_t writerError = ATOMIC_INIT(0);
+static atomic_t writerBusyTime = ATOMIC_INIT(0);
+
+FlashPipeline::FlashPipeline() {
+  this->stallTimeMs = 0;
+  this->writeTimeMs = 0;
+  this->currentSlot = -1;
+  this->currentOffset = 0;
+  this->currentLength = 0;
+}
+
+FlashPipeline::~FlashPipeline() {
+  // Slots still queued would be written with a writer that might not be valid anymore
+  this->drain();
+}
+
+void FlashPipeline::start(InplaceFunction<int(const uint8_t *, size_t, bool)> writer) {
+  assert(writer);
+
+  // The writer thread must be idle before its function is replaced
+  this->drain();
+
+  writerFunction = writer;
+  atomic_set(&writerError, 0);
+  atomic_set(&writerBusyTime, 0);
+  this->stallTimeMs = 0;
+  this->writeTimeMs = 0;
+}
+
+int FlashPipeline::write(const uint8_t *data, size_t length, bool flush) {
+  int ret = 0;
+  size_t copyLength = 0;
+
+  assert(data || (length == 0));
+
+  while (length > 0) {
+    ret = (int)atomic_get(&writerError);
+    if (ret < 0) {
+      return ret;
+    }
+
+    if (this->currentSlot < 0) {
+      this->takeSlot();
+    }
+
+    copyLength = MIN(length, FLASH_PIPELINE_SLOT_SIZE - this->currentLength);
+    memcpy(&slotBuffers[this->currentSlot][this->currentLength], data, copyLength);
+    this->currentLength += copyLength;
+    data += copyLength;
+    length -= copyLength;
+
+    if (this->currentLength == FLASH_PIPELINE_SLOT_SIZE) {
+      ret = this->submit(flush && (length == 0));
+      if (ret < 0) {
+        return ret;
+      }
+      if (flush && (length == 0)) {
+        return 0;
+      }
+    }
+  }
+
+  // The flush request must reach the writer even if it comes with a partially filled slot
+  if (flush) {
+    if (this->currentSlot < 0) {
+      this->takeSlot();
+    }
+    ret = this->submit(true);
+  }
+
+  return ret;
+}
+
+uint8_t *FlashPipeline::acquire(size_t *size) {
+  assert(size);
+
+  // A slot that is still held is handed over as is, it must not leak
+  if (this->currentSlot >= 0) {
+    this->submit(false);
+  }
+
+  this->takeSlot();
+  *size = FLASH_PIPELINE_SLOT_SIZE;
+
+  return slotBuffers[this->currentSlot];
+}
+
+int FlashPipeline::commit(const uint8_t *data, size_t length, bool flush) {
+  assert(this->currentSlot >= 0);
+
+  // The data was written in place by the caller, only its location within the slot is queued
+  if (length > 0) {
+    assert(data >= slotBuffers[this->currentSlot]);
+    assert((data + length) <= (slotBuffers[this->currentSlot] + FLASH_PIPELINE_SLOT_SIZE));
+    this->currentOffset = (size_t)(data - slotBuffers[this->currentSlot]);
+  }
+  this->currentLength = length;
+
+  return this->submit(flush);
+}
+
+int FlashPipeline::drain() {
+  uint32_t index = 0;
+
+  // Hand the partially filled slot over to the writer
+  if (this->currentSlot >= 0) {
+    this->submit(false);
+  }
+
+  // Once all the slots are free again, everything has been written
+  for (index = 0; index < FLASH_PIPELINE_SLOT_COUNT; index++) {
+    k_sem_take(&freeSlots, K_FOREVER);
+  }
+  for (index = 0; index < FLASH_PIPELINE_SLOT_COUNT; index++) {
+    k_sem_give(&freeSlots);
+  }
+
+  this->writeTimeMs = (uint32_t)atomic_get(&writerBusyTime);
+
+  return (int)atomic_get(&writerError);
+}
+
+void FlashPipeline::takeSlot() {
+  int64_t stallStart = 0;
+
+  // Grab a free slot, this only blocks when the writer is behind by SLOT_COUNT slots
+  stallStart = k_uptime_get();
+  k_sem_take(&freeSlots, K_FOREVER);
+  this->stallTimeMs += (uint32_t)(k_uptime_get() - stallStart);
+
+  this->currentSlot = nextSlot;
+  this->currentOffset = 0;
+  this->currentLength = 0;
+  nextSlot = (nextSlot + 1) % FLASH_PIPELINE_SLOT_COUNT;
+}
+
+int FlashPipeline::submit(bool flush) {
+  slot_descriptor_t descriptor = {0};
+
+  descriptor.slot = (uint32_t)this->currentSlot;
+  descriptor.offset = this->currentOffset;
+  descriptor.length = this->currentLength;
+  descriptor.flush = flush;
+  this->currentSlot = -1;
+  this->currentOffset = 0;
+  this->currentLength = 0;
+
+  // Cannot fail, there are as many queue entries as slots
+  k_msgq_put(&filledSlots, &descriptor, K_FOREVER);
+
+  return (int)atomic_get(&writerError);
+}
+
+static void flashWriterThreadHandler() {
+  int ret = 0;
+  int64_t writeStart = 0;
+  slot_descriptor_t descriptor = {0};
+
+  while (true) {
+    k_msgq_get(&filledSlots, &descriptor, K_FOREVER);
+
+    // After an error the remaining slots are only released, the producer stops at its next write
+    if (atomic_get(&writerError) == 0) {
+      writeStart = k_uptime_get();
+      ret = writerFunction(&slotBuffers[descriptor.slot][descriptor.offset],
+                           descriptor.length,
+                           descriptor.flush);
+      atomic_add(&writerBusyTime, (atomic_val_t)(k_uptime_get() - writeStart));
+      if (ret < 0) {
+        LOG_ERR("Flash write error: %d", ret);
+        atomic_set(&writerError, ret);
+      }
+    }
+
+    k_sem_give(&freeSlots);
+  }
+}
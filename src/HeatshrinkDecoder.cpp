@@ -0,0 +1,171 @@
+// Lib C
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(HeatshrinkDecoder);
+
+// User C++ class headers
+#include "HeatshrinkDecoder.h"
+
+BUILD_ASSERT((HEATSHRINK_WINDOW_BITS >= 4) && (HEATSHRINK_WINDOW_BITS <= 15), "Invalid window size");
+BUILD_ASSERT((HEATSHRINK_LOOKAHEAD_BITS >= 3) && (HEATSHRINK_LOOKAHEAD_BITS < HEATSHRINK_WINDOW_BITS),
+             "Invalid lookahead size");
+
+HeatshrinkDecoder::HeatshrinkDecoder() {
+  this->bytesWritten = 0;
+  this->decodeTimeMs = 0;
+  this->writeTimeMs = 0;
+  this->state = HeatshrinkDecoderState::TAG;
+  this->input = NULL;
+  this->inputLeft = 0;
+  this->bitBuffer = 0;
+  this->bitCount = 0;
+  this->distance = 0;
+  this->windowPosition = 0;
+  this->outputLength = 0;
+  this->decodeCycles = 0;
+  this->writeCycles = 0;
+  memset(this->window, 0x00, sizeof(this->window));
+  memset(this->output, 0x00, sizeof(this->output));
+}
+
+void HeatshrinkDecoder::start(InplaceFunction<int(const uint8_t *, size_t, bool)> writer) {
+  assert(writer);
+
+  this->writer = writer;
+  this->bytesWritten = 0;
+  this->decodeTimeMs = 0;
+  this->writeTimeMs = 0;
+  this->state = HeatshrinkDecoderState::TAG;
+  this->bitBuffer = 0;
+  this->bitCount = 0;
+  this->distance = 0;
+  this->windowPosition = 0;
+  this->outputLength = 0;
+  this->decodeCycles = 0;
+  this->writeCycles = 0;
+  // The encoder starts with a zeroed window as well, copies from before the start read zeros
+  memset(this->window, 0x00, sizeof(this->window));
+}
+
+int HeatshrinkDecoder::write(const uint8_t *data, size_t length) {
+  int ret = 0;
+  uint32_t value = 0;
+  uint32_t index = 0;
+  uint32_t startCycles = k_cycle_get_32();
+  uint64_t writeCyclesBefore = this->writeCycles;
+
+  assert(data || (length == 0));
+
+  this->input = data;
+  this->inputLeft = length;
+
+  // An item cut by the end of the fragment is completed by the next one
+  while (ret == 0) {
+    if (this->state == HeatshrinkDecoderState::TAG) {
+      if (!this->readBits(1, &value)) {
+        break;
+      }
+      this->state = value ? HeatshrinkDecoderState::LITERAL : HeatshrinkDecoderState::DISTANCE;
+    } else if (this->state == HeatshrinkDecoderState::LITERAL) {
+      if (!this->readBits(8, &value)) {
+        break;
+      }
+      ret = this->emit((uint8_t)value);
+      this->state = HeatshrinkDecoderState::TAG;
+    } else if (this->state == HeatshrinkDecoderState::DISTANCE) {
+      if (!this->readBits(HEATSHRINK_WINDOW_BITS, &value)) {
+        break;
+      }
+      this->distance = value + 1;
+      this->state = HeatshrinkDecoderState::LENGTH;
+    } else {
+      if (!this->readBits(HEATSHRINK_LOOKAHEAD_BITS, &value)) {
+        break;
+      }
+      for (index = 0; (index <= value) && (ret == 0); index++) {
+        ret = this->emit(this->window[(this->windowPosition - this->distance) & (HEATSHRINK_WINDOW_SIZE - 1)]);
+      }
+      this->state = HeatshrinkDecoderState::TAG;
+    }
+  }
+
+  this->decodeCycles += (k_cycle_get_32() - startCycles) - (uint32_t)(this->writeCycles - writeCyclesBefore);
+  this->decodeTimeMs = (uint32_t)k_cyc_to_ms_floor64(this->decodeCycles);
+  this->writeTimeMs = (uint32_t)k_cyc_to_ms_floor64(this->writeCycles);
+
+  return ret;
+}
+
+int HeatshrinkDecoder::finish() {
+  uint32_t pendingBits = this->bitCount;
+
+  // The encoder pads the last byte with up to 7 zero bits, which may already have been decoded as
+  // the start of a back-reference. Any other unfinished item means the input was cut short
+  if (this->state == HeatshrinkDecoderState::LITERAL) {
+    return -EBADMSG;
+  } else if (this->state == HeatshrinkDecoderState::DISTANCE) {
+    pendingBits += 1;
+  } else if (this->state == HeatshrinkDecoderState::LENGTH) {
+    if (this->distance != 1) {
+      return -EBADMSG;
+    }
+    pendingBits += 1 + HEATSHRINK_WINDOW_BITS;
+  }
+  if ((pendingBits >= 8) || (this->bitBuffer != 0)) {
+    return -EBADMSG;
+  }
+
+  return this->flush(true);
+}
+
+bool HeatshrinkDecoder::readBits(uint32_t count, uint32_t *value) {
+  while (this->bitCount < count) {
+    if (this->inputLeft == 0) {
+      return false;
+    }
+    this->bitBuffer = (this->bitBuffer << 8) | *this->input;
+    this->bitCount += 8;
+    this->input++;
+    this->inputLeft--;
+  }
+
+  this->bitCount -= count;
+  *value = (this->bitBuffer >> this->bitCount) & BIT_MASK(count);
+  this->bitBuffer &= BIT_MASK(this->bitCount);
+
+  return true;
+}
+
+int HeatshrinkDecoder::emit(uint8_t byte) {
+  this->window[this->windowPosition & (HEATSHRINK_WINDOW_SIZE - 1)] = byte;
+  this->windowPosition++;
+  this->output[this->outputLength++] = byte;
+
+  if (this->outputLength == sizeof(this->output)) {
+    return this->flush(false);
+  }
+
+  return 0;
+}
+
+int HeatshrinkDecoder::flush(bool last) {
+  int ret = 0;
+  uint32_t startCycles = k_cycle_get_32();
+
+  ret = this->writer(this->output, this->outputLength, last);
+  this->writeCycles += k_cycle_get_32() - startCycles;
+  if (ret < 0) {
+    LOG_ERR("Failed to write decompressed data (%d)", ret);
+    return ret;
+  }
+  this->bytesWritten += this->outputLength;
+  this->outputLength = 0;
+
+  return 0;
+}
@@ -1,138 +1,713 @@
 // Lib C
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <fcntl.h>
 #include <assert.h>
 
 // Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
 #include <zephyr/net/net_ip.h>
 #include <zephyr/net/socket.h>
 #include <zephyr/net/http/client.h>
+#include <zephyr/shell/shell.h>
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(HttpClient);
 
 // User C++ class headers
 #include "HttpClient.h"
+#include "BootTracer.h"
 
 static void responseCallback(http_response *response,
                                  enum http_final_call finalData,
                                  void *userData);
+static int payloadCallback(int sock, struct http_request *request, void *userData);
+static bool findHeaderField(const uint8_t *header,
+                            uint32_t length,
+                            const char *fieldName,
+                            char *value,
+                            size_t valueSize);
+static void parseContentRange(const uint8_t *header, uint32_t length, uint32_t *start, uint32_t *total);
+static void parseEtag(const uint8_t *header, uint32_t length, char *etag, size_t etagSize);
+static void recordRequest(const char *endpoint, const HttpRequestTiming *timing);
+static int32_t remainingMs(k_timepoint_t deadline);
+#ifdef CONFIG_DNS_RESOLVER
+static bool dnsCacheLookup(const char *host, struct in_addr *address);
+static void dnsCacheStore(const char *host, const struct in_addr *address);
+static void dnsCacheInvalidate(const char *host);
+#endif // CONFIG_DNS_RESOLVER
+static uint32_t histogramBucket(uint32_t totalUs);
+static int shellHttpStatsCommandHandler(const struct shell *shell, size_t argc, char **argv);
+static int shellHttpResetCommandHandler(const struct shell *shell, size_t argc, char **argv);
+static int shellHttpDnsCommandHandler(const struct shell *shell, size_t argc, char **argv);
+#ifdef CONFIG_NET_SOCKETS_SOCKOPT_TLS
+static int shellHttpTlsCommandHandler(const struct shell *shell, size_t argc, char **argv);
+#endif // CONFIG_NET_SOCKETS_SOCKOPT_TLS
+static void httpWorkerThreadHandler(void *p1, void *p2, void *p3);
+static int httpWorkersInit();
 
-HttpClient::HttpClient(char *server, uint16_t port) {
+// Asynchronous requests waiting for a worker
+K_FIFO_DEFINE(httpRequestQueue);
+
+// Worker threads executing the asynchronous requests, started at boot
+K_THREAD_STACK_ARRAY_DEFINE(httpWorkerStacks,
+                            CONFIG_HTTP_CLIENT_ASYNC_WORKERS,
+                            CONFIG_HTTP_CLIENT_ASYNC_STACK_SIZE);
+static struct k_thread httpWorkerThreads[CONFIG_HTTP_CLIENT_ASYNC_WORKERS];
+SYS_INIT(httpWorkersInit, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+// Extra header fields sent with every request depending on the connection mode
+static const char *keepAliveHeaders[] = {"Connection: keep-alive\r\n", NULL};
+static const char *closeHeaders[] = {"Connection: close\r\n", NULL};
+
+typedef struct {
+  HttpEndpointStats stats;
+  // Histogram bucket of each of the last requests, the oldest one leaves the histogram when the
+  // window is full
+  uint8_t window[HTTP_CLIENT_HISTOGRAM_WINDOW];
+  uint32_t windowIndex;
+  uint32_t windowCount;
+} http_endpoint_entry_t;
+
+BUILD_ASSERT(HTTP_CLIENT_HISTOGRAM_BUCKETS <= UINT8_MAX, "Histogram buckets don't fit in the window");
+BUILD_ASSERT(HTTP_CLIENT_HISTOGRAM_WINDOW <= UINT16_MAX, "Histogram window doesn't fit in the buckets");
+
+// Shared by all the clients, endpoints are added in the order they are first requested
+K_MUTEX_DEFINE(httpStatsLock);
+static http_endpoint_entry_t httpEndpoints[HTTP_CLIENT_STATS_MAX_ENDPOINTS];
+static uint32_t httpEndpointCount = 0;
+static uint32_t httpUntrackedRequests = 0;
+
+// Longer host names are resolved on every connection
+static constexpr uint32_t HTTP_CLIENT_DNS_HOST_LENGTH = 64;
+
+#ifdef CONFIG_DNS_RESOLVER
+typedef struct {
+  // Empty when the first character is 0
+  char host[HTTP_CLIENT_DNS_HOST_LENGTH];
+  struct in_addr address;
+  int64_t expiryTime;
+} dns_cache_entry_t;
+
+// Shared by all the clients
+K_MUTEX_DEFINE(httpDnsLock);
+static dns_cache_entry_t dnsCache[CONFIG_HTTP_CLIENT_DNS_CACHE_SIZE];
+static HttpDnsStats dnsStats = {0};
+#endif // CONFIG_DNS_RESOLVER
+
+#ifdef CONFIG_NET_SOCKETS_SOCKOPT_TLS
+// Connections made by 'http tls', the first one after the session cache was flushed does a full
+// handshake and the following ones resume the session
+static constexpr uint32_t HTTP_CLIENT_TLS_BENCHMARK_ROUNDS = 4;
+static constexpr uint16_t HTTP_CLIENT_TLS_DEFAULT_PORT = 443;
+static constexpr sec_tag_t HTTP_CLIENT_TLS_DEFAULT_SEC_TAG = 1;
+#endif // CONFIG_NET_SOCKETS_SOCKOPT_TLS
+
+// Shell command registration
+#ifdef CONFIG_NET_SOCKETS_SOCKOPT_TLS
+SHELL_STATIC_SUBCMD_SET_CREATE(
+  httpSubcommands,
+  SHELL_CMD(stats, NULL, "Timings, bytes transferred and duration histogram of each endpoint", shellHttpStatsCommandHandler),
+  SHELL_CMD(reset, NULL, "Clear the endpoint statistics", shellHttpResetCommandHandler),
+  SHELL_CMD_ARG(dns, NULL, "DNS cache content and resolution times, [flush] empties the cache", shellHttpDnsCommandHandler, 1, 1),
+  SHELL_CMD_ARG(tls, NULL, "Compare full and resumed TLS handshakes with <host> [port] [sec_tag]", shellHttpTlsCommandHandler, 2, 2),
+  SHELL_SUBCMD_SET_END
+);
+#else
+SHELL_STATIC_SUBCMD_SET_CREATE(
+  httpSubcommands,
+  SHELL_CMD(stats, NULL, "Timings, bytes transferred and duration histogram of each endpoint", shellHttpStatsCommandHandler),
+  SHELL_CMD(reset, NULL, "Clear the endpoint statistics", shellHttpResetCommandHandler),
+  SHELL_CMD_ARG(dns, NULL, "DNS cache content and resolution times, [flush] empties the cache", shellHttpDnsCommandHandler, 1, 1),
+  SHELL_SUBCMD_SET_END
+);
+#endif // CONFIG_NET_SOCKETS_SOCKOPT_TLS
+SHELL_CMD_REGISTER(http, &httpSubcommands, "HTTP client statistics", NULL);
+
+HttpClient::HttpClient(char *server, uint16_t port, bool keepAlive) {
   assert(server);
   assert(port);
 
   // 1. Initialize attributes
-  this->sock = 0;
+  this->sock = -1;
   this->server = server;
   this->port = port;
+  this->keepAlive = keepAlive;
+  this->tls = false;
+  this->secTag = 0;
+  this->cacheTlsSessions = false;
+  this->responseReceived = false;
+  this->responseAborted = false;
+  this->rangeStart = 0;
+  this->rangeTotal = 0;
+  this->etag[0] = '\0';
+  this->options = NULL;
+  this->requestStartTicks = 0;
+  k_mutex_init(&this->lock);
   memset((void *)&this->socketAddress, 0x00, sizeof(this->socketAddress));
   memset((void *)&this->responseBuffer, 0x00, sizeof(this->responseBuffer));
+  memset((void *)&this->timing, 0x00, sizeof(this->timing));
 }
 
 HttpClient::~HttpClient() {
-  // Destructor is automatically called when the object goes out of scope or is explicitly deleted
+  // Make sure a kept-alive connection doesn't outlive the client
+  this->disconnect();
 }
 
-int HttpClient::get(const char *endpoint, std::function<void(HttpResponse *)> callback) {
+int HttpClient::get(const char *endpoint,
+                    const InplaceFunction<void(HttpResponse *)> &callback,
+                    const HttpRequestOptions *options) {
   int ret = 0;
-  struct http_request request = {0};
 
   assert(endpoint);
   assert(callback);
 
-  // 0. Create socket
+  k_mutex_lock(&this->lock, K_FOREVER);
+  ret = this->sendRequest(HTTP_GET, endpoint, NULL, 0, callback, options);
+  k_mutex_unlock(&this->lock);
+
+  return ret;
+}
+
+int HttpClient::post(const char *endpoint,
+                     const char *data,
+                     uint32_t length,
+                     const InplaceFunction<void(HttpResponse *)> &callback,
+                     const HttpRequestOptions *options) {
+  int ret = 0;
+
+  assert(endpoint);
+  assert(data);
+  assert(length);
+  assert(callback);
+
+  k_mutex_lock(&this->lock, K_FOREVER);
+  ret = this->sendRequest(HTTP_POST, endpoint, data, length, callback, options);
+  k_mutex_unlock(&this->lock);
+
+  return ret;
+}
+
+int HttpClient::submit(HttpAsyncRequest *request) {
+  assert(request);
+  assert(request->endpoint);
+  assert(request->callback);
+
+  request->client = this;
+  request->result = -EINPROGRESS;
+  k_fifo_put(&httpRequestQueue, request);
+
+  return 0;
+}
+
+void HttpClient::execute(HttpAsyncRequest *request) {
+  int result = 0;
+  struct k_poll_signal *signal = NULL;
+
+  assert(request);
+
+  k_mutex_lock(&this->lock, K_FOREVER);
+  result = this->sendRequest(request->method,
+                             request->endpoint,
+                             request->data,
+                             request->length,
+                             request->callback,
+                             request->options);
+  k_mutex_unlock(&this->lock);
+
+  // The request may be reused or released by the caller as soon as it is notified, nothing of it
+  // is read once onComplete() has been called
+  request->result = result;
+  signal = request->signal;
+  if (request->onComplete) {
+    request->onComplete(request);
+  }
+  if (signal) {
+    k_poll_signal_raise(signal, result);
+  }
+}
+
+void HttpClient::abort() {
+  this->responseAborted = true;
+}
+
+void HttpClient::getLastTiming(HttpRequestTiming *timing) {
+  assert(timing);
+
+  k_mutex_lock(&this->lock, K_FOREVER);
+  memcpy(timing, &this->timing, sizeof(*timing));
+  k_mutex_unlock(&this->lock);
+}
+
+int HttpClient::getEndpointStats(uint32_t index, HttpEndpointStats *stats) {
+  int ret = 0;
+
+  assert(stats);
+
+  k_mutex_lock(&httpStatsLock, K_FOREVER);
+  if (index < httpEndpointCount) {
+    memcpy(stats, &httpEndpoints[index].stats, sizeof(*stats));
+  } else {
+    ret = -ENOENT;
+  }
+  k_mutex_unlock(&httpStatsLock);
+
+  return ret;
+}
+
+void HttpClient::resetStats() {
+  k_mutex_lock(&httpStatsLock, K_FOREVER);
+  memset(httpEndpoints, 0x00, sizeof(httpEndpoints));
+  httpEndpointCount = 0;
+  httpUntrackedRequests = 0;
+  k_mutex_unlock(&httpStatsLock);
+}
+
+int HttpClient::enableTls(sec_tag_t secTag, bool cacheSessions) {
+#ifdef CONFIG_NET_SOCKETS_SOCKOPT_TLS
+  k_mutex_lock(&this->lock, K_FOREVER);
+  // A kept-alive plain connection must not be reused for the next request
+  this->disconnect();
+  this->tls = true;
+  this->secTag = secTag;
+  this->cacheTlsSessions = cacheSessions;
+  k_mutex_unlock(&this->lock);
+
+  return 0;
+#else
+  ARG_UNUSED(secTag);
+  ARG_UNUSED(cacheSessions);
+
+  LOG_ERR("TLS sockets are disabled, build with overlay_tls.conf");
+  return -ENOTSUP;
+#endif // CONFIG_NET_SOCKETS_SOCKOPT_TLS
+}
+
+int HttpClient::flushTlsSessions() {
+#ifdef CONFIG_NET_SOCKETS_SOCKOPT_TLS
+  int ret = 0;
+  int sock = -1;
+
+  // The session cache is shared by all the TLS sockets, any of them can purge it
+  sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TLS_1_2);
+  if (sock < 0) {
+    return -errno;
+  }
+  ret = setsockopt(sock, SOL_TLS, TLS_SESSION_CACHE_PURGE, NULL, 0);
+  if (ret < 0) {
+    ret = -errno;
+  }
+  close(sock);
+
+  return ret;
+#else
+  return -ENOTSUP;
+#endif // CONFIG_NET_SOCKETS_SOCKOPT_TLS
+}
+
+void HttpClient::getDnsStats(HttpDnsStats *stats) {
+  assert(stats);
+
+#ifdef CONFIG_DNS_RESOLVER
+  k_mutex_lock(&httpDnsLock, K_FOREVER);
+  memcpy(stats, &dnsStats, sizeof(*stats));
+  k_mutex_unlock(&httpDnsLock);
+#else
+  memset(stats, 0x00, sizeof(*stats));
+#endif // CONFIG_DNS_RESOLVER
+}
+
+void HttpClient::flushDnsCache() {
+#ifdef CONFIG_DNS_RESOLVER
+  k_mutex_lock(&httpDnsLock, K_FOREVER);
+  memset(dnsCache, 0x00, sizeof(dnsCache));
+  k_mutex_unlock(&httpDnsLock);
+#endif // CONFIG_DNS_RESOLVER
+}
+
+void HttpClient::onRequestSent() {
+  this->timing.requestSentUs = this->elapsedUs();
+}
+
+void HttpClient::onResponseData(uint32_t length, bool isFinal) {
+  this->timing.bytesReceived += length;
+  if (this->timing.firstByteUs == 0) {
+    this->timing.firstByteUs = this->elapsedUs();
+  }
+  if (isFinal) {
+    this->timing.lastByteUs = this->elapsedUs();
+  }
+}
+
+void HttpClient::disconnect() {
+  if (this->sock >= 0) {
+    close(this->sock);
+    this->sock = -1;
+  }
+}
+
+int HttpClient::resolveServer() {
+#ifdef CONFIG_DNS_RESOLVER
+  int ret = 0;
+  uint32_t startCycles = 0;
+  uint32_t resolutionUs = 0;
+  struct zsock_addrinfo hints = {0};
+  struct zsock_addrinfo *result = NULL;
+#endif // CONFIG_DNS_RESOLVER
+  struct sockaddr_in *address = net_sin(&this->socketAddress);
+
   memset((void *)&this->socketAddress, 0x00, sizeof(this->socketAddress));
-  net_sin(&this->socketAddress)->sin_family = AF_INET;
-  net_sin(&this->socketAddress)->sin_port = htons(port);
-  inet_pton(AF_INET, server, &net_sin(&this->socketAddress)->sin_addr);
-  this->sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  address->sin_family = AF_INET;
+  address->sin_port = htons(this->port);
+
+  // Dotted-quad addresses don't need any resolution
+  if (inet_pton(AF_INET, this->server, &address->sin_addr) == 1) {
+    return 0;
+  }
+
+#ifdef CONFIG_DNS_RESOLVER
+  startCycles = k_cycle_get_32();
+  this->timing.resolvedFromCache = dnsCacheLookup(this->server, &address->sin_addr);
+  if (!this->timing.resolvedFromCache) {
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    ret = getaddrinfo(this->server, NULL, &hints, &result);
+    if ((ret != 0) || (result == NULL)) {
+      LOG_ERR("Cannot resolve %s (%d)", this->server, ret);
+      k_mutex_lock(&httpDnsLock, K_FOREVER);
+      dnsStats.failures++;
+      k_mutex_unlock(&httpDnsLock);
+      return -EHOSTUNREACH;
+    }
+    address->sin_addr = net_sin(result->ai_addr)->sin_addr;
+    freeaddrinfo(result);
+    dnsCacheStore(this->server, &address->sin_addr);
+  }
+  resolutionUs = k_cyc_to_us_floor32(k_cycle_get_32() - startCycles);
+  this->timing.resolveUs = this->elapsedUs();
+
+  k_mutex_lock(&httpDnsLock, K_FOREVER);
+  if (this->timing.resolvedFromCache) {
+    dnsStats.hits++;
+    dnsStats.hitUs += resolutionUs;
+  } else {
+    dnsStats.misses++;
+    dnsStats.missUs += resolutionUs;
+  }
+  k_mutex_unlock(&httpDnsLock);
+
+  return 0;
+#else
+  LOG_ERR("%s is not an IPv4 address and DNS_RESOLVER is disabled", this->server);
+  return -EINVAL;
+#endif // CONFIG_DNS_RESOLVER
+}
+
+int HttpClient::connectToServer(int32_t timeoutMs) {
+  int ret = 0;
+  int flags = 0;
+  int error = 0;
+  socklen_t errorLength = sizeof(error);
+  struct pollfd fds = {0};
+
+  // 0. Resolve the server address and create socket
+  ret = this->resolveServer();
+  if (ret < 0) {
+    return ret;
+  }
+  this->sock = socket(AF_INET, SOCK_STREAM, this->tls ? IPPROTO_TLS_1_2 : IPPROTO_TCP);
+  this->timing.socketUs = this->elapsedUs();
 
   if (this->sock < 0) {
     LOG_ERR("Failed to create HTTP socket (%d)\r\n", -errno);
+    return -errno;
   }
 
-  this->callback = callback;
+  if (this->tls) {
+    ret = this->configureTls();
+    if (ret < 0) {
+      this->disconnect();
+      return ret;
+    }
+  }
 
-  // 1. Open TCP connection
-  ret = connect(this->sock, &this->socketAddress, sizeof(this->socketAddress));
+  // 1. Open TCP connection without blocking, so that it is bounded by the request timeout. On a TLS
+  // socket the handshake is done by connect() on a blocking socket, it is bounded by send and
+  // receive timeouts set to the time left instead
+  flags = fcntl(this->sock, F_GETFL, 0);
+  if (this->tls) {
+    ret = this->setSocketTimeouts(timeoutMs);
+  } else {
+    fcntl(this->sock, F_SETFL, flags | O_NONBLOCK);
+  }
+  if (ret == 0) {
+    ret = connect(this->sock, &this->socketAddress, sizeof(this->socketAddress));
+  }
+  if ((ret < 0) && (errno == EINPROGRESS)) {
+    fds.fd = this->sock;
+    fds.events = POLLOUT;
+    ret = poll(&fds, 1, timeoutMs);
+    if (ret == 0) {
+      errno = ETIMEDOUT;
+      ret = -1;
+    } else if (ret > 0) {
+      ret = getsockopt(this->sock, SOL_SOCKET, SO_ERROR, &error, &errorLength);
+      if ((ret == 0) && (error != 0)) {
+        errno = error;
+        ret = -1;
+      }
+    }
+  }
   if (ret < 0) {
     LOG_ERR("Cannot connect to remote (%d)", -errno);
     ret = -errno;
+    this->disconnect();
+#ifdef CONFIG_DNS_RESOLVER
+    // The host may have moved, resolve it again next time
+    dnsCacheInvalidate(this->server);
+#endif // CONFIG_DNS_RESOLVER
     return ret;
   }
 
-  // 2. Send GET request
-  request.method = HTTP_GET;
-  request.url = endpoint;
-  request.host = this->server;
-  request.protocol = "HTTP/1.1";
-  request.response = responseCallback;
-  request.recv_buf = this->responseBuffer;
-  request.recv_buf_len = sizeof(this->responseBuffer);
-  ret = http_client_req(this->sock, &request, 5000, (void *)&this->callback);
-  if (ret < 0) {
-    LOG_ERR("Error sending GET request\r\n");
-    ret = -errno;
-    return ret;
+  this->timing.connectUs = this->elapsedUs();
+
+  // 2. Back to blocking mode without timeouts, http_client_req() does its own polling with the
+  // request timeout
+  if (this->tls) {
+    this->setSocketTimeouts(SYS_FOREVER_MS);
+  }
+  fcntl(this->sock, F_SETFL, flags);
+
+  return 0;
+}
+
+// SYS_FOREVER_MS removes the timeouts, a zero timeout fails with ETIMEDOUT since it would do the same
+int HttpClient::setSocketTimeouts(int32_t timeoutMs) {
+  struct timeval timeout = {0};
+
+  if (timeoutMs == 0) {
+    errno = ETIMEDOUT;
+    return -1;
+  }
+
+  if (timeoutMs != SYS_FOREVER_MS) {
+    timeout.tv_sec = timeoutMs / MSEC_PER_SEC;
+    timeout.tv_usec = (timeoutMs % MSEC_PER_SEC) * USEC_PER_MSEC;
   }
 
-  // 3. Close TCP connection
-  close(this->sock);
+  if ((setsockopt(this->sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) ||
+      (setsockopt(this->sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) < 0)) {
+    return -1;
+  }
 
-  return ret;
+  return 0;
 }
 
-int HttpClient::post(const char *endpoint,
-                     const char *data,
-                     uint32_t length,
-                     std::function<void(HttpResponse *)> callback) {
+int HttpClient::configureTls() {
+#ifdef CONFIG_NET_SOCKETS_SOCKOPT_TLS
   int ret = 0;
-  struct http_request request = {0};
+  int sessionCache = this->cacheTlsSessions ? TLS_SESSION_CACHE_ENABLED : TLS_SESSION_CACHE_DISABLED;
+  sec_tag_t secTags[] = {this->secTag};
 
-  assert(endpoint);
-  assert(data);
-  assert(length);
-  assert(callback);
+  ret = setsockopt(this->sock, SOL_TLS, TLS_SEC_TAG_LIST, secTags, sizeof(secTags));
+  if (ret < 0) {
+    LOG_ERR("Failed to set TLS security tag %d (%d)", this->secTag, -errno);
+    return -errno;
+  }
 
-  // 0. Create socket
-  memset((void *)&this->socketAddress, 0x00, sizeof(this->socketAddress));
-  net_sin(&this->socketAddress)->sin_family = AF_INET;
-  net_sin(&this->socketAddress)->sin_port = htons(port);
-  inet_pton(AF_INET, server, &net_sin(&this->socketAddress)->sin_addr);
-  this->sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  // Used for SNI and checked against the server certificate
+  ret = setsockopt(this->sock, SOL_TLS, TLS_HOSTNAME, this->server, strlen(this->server) + 1);
+  if (ret < 0) {
+    LOG_ERR("Failed to set TLS host name (%d)", -errno);
+    return -errno;
+  }
+
+  // Sessions are cached per server address, the next connect() to it resumes the session
+  ret = setsockopt(this->sock, SOL_TLS, TLS_SESSION_CACHE, &sessionCache, sizeof(sessionCache));
+  if (ret < 0) {
+    LOG_WRN("Failed to enable the TLS session cache (%d)", -errno);
+  }
+
+  return 0;
+#else
+  return -ENOTSUP;
+#endif // CONFIG_NET_SOCKETS_SOCKOPT_TLS
+}
+
+bool HttpClient::connectionIsAlive() {
+  int ret = 0;
+  uint8_t byte = 0;
+  struct pollfd fds = {0};
 
   if (this->sock < 0) {
-    LOG_ERR("Failed to create HTTP socket (%d)\r\n", -errno);
+    return false;
+  }
+
+  // An idle kept-alive connection must have nothing to read, anything else means that the server
+  // closed it (EOF), reset it, or sent unexpected data that would corrupt the next response
+  fds.fd = this->sock;
+  fds.events = POLLIN;
+  ret = poll(&fds, 1, 0);
+  if (ret == 0) {
+    return true;
+  }
+
+  if ((ret > 0) && (fds.revents & POLLIN) && !(fds.revents & (POLLERR | POLLHUP | POLLNVAL))) {
+    ret = recv(this->sock, &byte, sizeof(byte), MSG_PEEK | MSG_DONTWAIT);
+    if (ret > 0) {
+      LOG_WRN("Unexpected data pending on idle connection, dropping it");
+    }
+  }
+
+  return false;
+}
+
+uint32_t HttpClient::elapsedUs() {
+  // Ticks rather than cycles, a firmware download lasts longer than the 32 bits cycle counter wraps
+  return (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks() - this->requestStartTicks);
+}
+
+int HttpClient::sendRequest(enum http_method method,
+                            const char *endpoint,
+                            const char *data,
+                            uint32_t length,
+                            const InplaceFunction<void(HttpResponse *)> &callback,
+                            const HttpRequestOptions *options) {
+  int ret = 0;
+
+  BootTracer::getInstance().mark(BootMilestone::FIRST_HTTP_REQUEST);
+  memset((void *)&this->timing, 0x00, sizeof(this->timing));
+  this->timing.tls = this->tls;
+  this->requestStartTicks = k_uptime_ticks();
+
+  ret = this->exchange(method, endpoint, data, length, callback, options);
+  if (ret >= 0) {
+    BootTracer::getInstance().mark(BootMilestone::FIRST_HTTP_RESPONSE);
+  }
+
+  // http_client_req() returns the number of bytes sent
+  this->timing.bytesSent = (ret > 0) ? (uint32_t)ret : 0;
+  this->timing.result = (ret < 0) ? ret : 0;
+  if (this->timing.lastByteUs == 0) {
+    this->timing.lastByteUs = this->elapsedUs();
   }
+  recordRequest(endpoint, &this->timing);
+
+  return ret;
+}
+
+int HttpClient::exchange(enum http_method method,
+                         const char *endpoint,
+                         const char *data,
+                         uint32_t length,
+                         const InplaceFunction<void(HttpResponse *)> &callback,
+                         const HttpRequestOptions *options) {
+  int ret = 0;
+  bool reusingConnection = false;
+  int32_t timeoutMs = HTTP_CLIENT_DEFAULT_TIMEOUT_MS;
+  k_timepoint_t deadline = {0};
+  struct http_request request = {0};
 
   this->callback = callback;
+  if (options && (options->timeoutMs > 0)) {
+    timeoutMs = options->timeoutMs;
+  }
+  // Every step gets what is left of the request timeout, including a request sent again
+  deadline = sys_timepoint_calc(K_MSEC(timeoutMs));
 
-  // 1. Open TCP connection
-  ret = connect(this->sock, &this->socketAddress, sizeof(this->socketAddress));
-  if (ret < 0) {
-    LOG_ERR("Cannot connect to remote (%d)", -errno);
-    ret = -errno;
-    return ret;
+  // 0. Reuse the kept-alive connection if the server didn't close it in the meantime
+  reusingConnection = this->keepAlive && this->connectionIsAlive();
+  this->timing.reusedConnection = reusingConnection;
+  if (!reusingConnection) {
+    this->disconnect();
+    ret = this->connectToServer(remainingMs(deadline));
+    if (ret < 0) {
+      return ret;
+    }
+  } else {
+    LOG_DBG("Reusing connection to %s:%d", this->server, this->port);
   }
 
-  // 2. Send POST request
-  request.method = HTTP_POST;
-  request.host = this->server;
+  // 1. Send request
+  request.method = method;
   request.url = endpoint;
+  request.host = this->server;
   request.protocol = "HTTP/1.1";
+  request.header_fields = this->keepAlive ? keepAliveHeaders : closeHeaders;
+  request.optional_headers = options ? options->headers : NULL;
   request.response = responseCallback;
+  // The payload is sent by the callback, that is the only way to know when the request is out
   request.payload = data;
   request.payload_len = length;
-  request.recv_buf = this->responseBuffer;
-  request.recv_buf_len = sizeof(this->responseBuffer);
-  ret = http_client_req(this->sock, &request, 5000, (void *)this);
+  request.payload_cb = payloadCallback;
+  if (options && options->buffer) {
+    request.recv_buf = options->buffer;
+    request.recv_buf_len = options->bufferSize;
+  } else {
+    request.recv_buf = this->responseBuffer;
+    request.recv_buf_len = sizeof(this->responseBuffer);
+  }
+  this->options = options;
+
+  this->responseReceived = false;
+  this->responseAborted = false;
+  this->rangeStart = 0;
+  this->rangeTotal = 0;
+  this->etag[0] = '\0';
+  timeoutMs = remainingMs(deadline);
+  if (timeoutMs == 0) {
+    ret = -ETIMEDOUT;
+  } else {
+    ret = http_client_req(this->sock, &request, timeoutMs, (void *)this);
+  }
+
+  // The server may close a kept-alive connection right when we reuse it. The request is only sent
+  // again when the connection was closed or reset before a single byte was read, a timeout may
+  // mean the server got the request and is still acting on it
+  if (reusingConnection &&
+      !this->responseReceived &&
+      (this->timing.bytesReceived == 0) &&
+      ((ret >= 0) || (ret == -ECONNRESET)) &&
+      ((method != HTTP_POST) || (options && options->retryPost))) {
+    LOG_DBG("Kept-alive connection was closed by the server, reconnecting");
+    this->timing.reusedConnection = false;
+    this->timing.resolvedFromCache = false;
+    this->timing.bytesReceived = 0;
+    this->timing.firstByteUs = 0;
+    this->disconnect();
+    ret = this->connectToServer(remainingMs(deadline));
+    if (ret < 0) {
+      return ret;
+    }
+    timeoutMs = remainingMs(deadline);
+    if (timeoutMs == 0) {
+      ret = -ETIMEDOUT;
+    } else {
+      ret = http_client_req(this->sock, &request, timeoutMs, (void *)this);
+    }
+  } else if (reusingConnection && !this->responseReceived && (ret >= 0)) {
+    // Closed without an answer and not sent again, the caller decides whether to retry
+    ret = -ECONNRESET;
+  }
+
+  // The rest of the response may still be on its way, the connection can't be reused
+  if (this->responseAborted) {
+    LOG_DBG("%s response aborted by the caller", http_method_str(method));
+    this->disconnect();
+    return -ECONNABORTED;
+  }
+
   if (ret < 0) {
-    LOG_ERR("Error sending POST request\r\n");
-    ret = -errno;
+    LOG_ERR("Error sending %s request (%d)\r\n", http_method_str(method), ret);
+    this->disconnect();
     return ret;
   }
 
-  // 3. Close TCP connection
-  close(this->sock);
+  // 2. Close TCP connection unless it should be kept alive for the next request
+  if (!this->keepAlive || !this->responseReceived) {
+    this->disconnect();
+  }
 
   return ret;
 }
@@ -140,11 +715,38 @@ int HttpClient::post(const char *endpoint,
 static void responseCallback(http_response *response, enum http_final_call finalData, void *userData) {
   HttpClient *clientInstance  = static_cast<HttpClient *>(userData);
   HttpResponse httpResponse = {0};
+  uint32_t headerLength = 0;
+  uint8_t *nextBuffer = NULL;
+  size_t nextBufferSize = 0;
 
   assert(userData);
   assert(response);
   assert(clientInstance);
 
+  // Connection was closed before anything was received, there is nothing to report
+  if ((response->http_status_code == 0) && (response->data_len == 0)) {
+    return;
+  }
+
+  // The caller already gave up on this response, http_client_req() stops after this fragment
+  if (clientInstance->responseAborted) {
+    response->message_complete = 1;
+    return;
+  }
+
+  // Headers are entirely contained in the first fragment of the response
+  if (!clientInstance->responseReceived) {
+    headerLength = response->body_found ? (response->data_len - response->body_frag_len)
+                                        : response->data_len;
+    parseContentRange(response->recv_buf,
+                      headerLength,
+                      &clientInstance->rangeStart,
+                      &clientInstance->rangeTotal);
+    parseEtag(response->recv_buf, headerLength, clientInstance->etag, sizeof(clientInstance->etag));
+  }
+  clientInstance->responseReceived = true;
+  clientInstance->onResponseData(response->data_len, (finalData == HTTP_DATA_FINAL));
+
   if (response->body_found) {
     httpResponse.header = response->recv_buf;
     httpResponse.headerLength = response->data_len - response->body_frag_len;
@@ -157,8 +759,459 @@ static void responseCallback(http_response *response, enum http_final_call final
     httpResponse.headerLength = response->data_len;
   }
   httpResponse.statusCode = response->http_status_code;
+  httpResponse.rangeStart = clientInstance->rangeStart;
+  httpResponse.rangeTotal = clientInstance->rangeTotal;
+  httpResponse.etag = (clientInstance->etag[0] != '\0') ? clientInstance->etag : NULL;
 
   if (clientInstance->callback) {
     clientInstance->callback(&httpResponse);
   }
+
+  // Reported as complete so that http_client_req() returns without reading the rest of the response
+  if (clientInstance->responseAborted) {
+    response->message_complete = 1;
+    return;
+  }
+
+  // The client refills response->recv_buf from its start after each non final callback, switching
+  // it to another caller buffer lets the caller keep the data it was just given without a copy
+  if ((finalData == HTTP_DATA_MORE) &&
+      clientInstance->options &&
+      clientInstance->options->nextBuffer) {
+    nextBuffer = clientInstance->options->nextBuffer(&nextBufferSize);
+    if (nextBuffer && nextBufferSize) {
+      response->recv_buf = nextBuffer;
+      response->recv_buf_len = nextBufferSize;
+    }
+  }
+}
+
+static int payloadCallback(int sock, struct http_request *request, void *userData) {
+  HttpClient *clientInstance = static_cast<HttpClient *>(userData);
+  uint32_t sent = 0;
+  ssize_t ret = 0;
+
+  assert(request);
+  assert(clientInstance);
+
+  // Called once the headers have been flushed, GET requests have no payload
+  while (request->payload && (sent < request->payload_len)) {
+    ret = send(sock, &request->payload[sent], request->payload_len - sent, 0);
+    if (ret < 0) {
+      return -errno;
+    }
+    sent += ret;
+  }
+  clientInstance->onRequestSent();
+
+  return (int)sent;
+}
+
+// Copy the value of a header field (case insensitive name, e.g. "\r\nETag:") as a C string, false
+// when the field is absent or its value doesn't fit
+static bool findHeaderField(const uint8_t *header,
+                            uint32_t length,
+                            const char *fieldName,
+                            char *value,
+                            size_t valueSize) {
+  const size_t fieldNameLength = strlen(fieldName);
+  uint32_t index = 0;
+  uint32_t valueLength = 0;
+
+  assert(header);
+  assert(fieldName);
+  assert(value);
+  assert(valueSize > 0);
+
+  value[0] = '\0';
+
+  // Look for the field name at the beginning of a header line
+  for (index = 0; (index + fieldNameLength) <= length; index++) {
+    if (strncasecmp((const char *)&header[index], fieldName, fieldNameLength) == 0) {
+      break;
+    }
+  }
+  if ((index + fieldNameLength) > length) {
+    return false;
+  }
+
+  // Copy the value up to the end of line
+  index += fieldNameLength;
+  while ((index < length) && (header[index] == ' ')) {
+    index++;
+  }
+  while ((index < length) && (header[index] != '\r')) {
+    if (valueLength >= (valueSize - 1)) {
+      value[0] = '\0';
+      return false;
+    }
+    value[valueLength++] = (char)header[index++];
+  }
+  value[valueLength] = '\0';
+
+  return true;
+}
+
+static void parseContentRange(const uint8_t *header, uint32_t length, uint32_t *start, uint32_t *total) {
+  char value[48] = {0};
+  char *cursor = NULL;
+
+  assert(start);
+  assert(total);
+
+  *start = 0;
+  *total = 0;
+
+  // Expected format: "bytes <first>-<last>/<total>"
+  if (!findHeaderField(header, length, "\r\nContent-Range:", value, sizeof(value)) ||
+      (strncmp(value, "bytes ", 6) != 0)) {
+    return;
+  }
+  *start = strtoul(&value[6], &cursor, 10);
+  cursor = strchr(cursor, '/');
+  if (cursor) {
+    *total = strtoul(cursor + 1, NULL, 10);
+  }
+}
+
+static void parseEtag(const uint8_t *header, uint32_t length, char *etag, size_t etagSize) {
+  // If-Range only accepts strong entity tags, which are quoted: "<tag>"
+  if (!findHeaderField(header, length, "\r\nETag:", etag, etagSize) || (etag[0] != '"')) {
+    etag[0] = '\0';
+  }
+}
+
+static void recordRequest(const char *endpoint, const HttpRequestTiming *timing) {
+  uint32_t index = 0;
+  uint32_t bucket = 0;
+  http_endpoint_entry_t *entry = NULL;
+  HttpEndpointStats *stats = NULL;
+
+  assert(endpoint);
+  assert(timing);
+
+  k_mutex_lock(&httpStatsLock, K_FOREVER);
+
+  // Endpoints longer than the name field are only told apart by their beginning
+  for (index = 0; index < httpEndpointCount; index++) {
+    if (strncmp(httpEndpoints[index].stats.endpoint, endpoint, HTTP_CLIENT_STATS_ENDPOINT_LENGTH - 1) == 0) {
+      entry = &httpEndpoints[index];
+      break;
+    }
+  }
+  if (!entry && (httpEndpointCount < HTTP_CLIENT_STATS_MAX_ENDPOINTS)) {
+    entry = &httpEndpoints[httpEndpointCount++];
+    strncpy(entry->stats.endpoint, endpoint, HTTP_CLIENT_STATS_ENDPOINT_LENGTH - 1);
+  }
+  if (!entry) {
+    httpUntrackedRequests++;
+    k_mutex_unlock(&httpStatsLock);
+    return;
+  }
+
+  stats = &entry->stats;
+  stats->requests++;
+  stats->bytesSent += timing->bytesSent;
+  stats->bytesReceived += timing->bytesReceived;
+  memcpy(&stats->last, timing, sizeof(stats->last));
+  if (timing->result < 0) {
+    stats->failures++;
+    k_mutex_unlock(&httpStatsLock);
+    return;
+  }
+
+  stats->connectUs += timing->connectUs;
+  stats->firstByteUs += timing->firstByteUs;
+  stats->transferUs += timing->lastByteUs - timing->firstByteUs;
+  stats->totalUs += timing->lastByteUs;
+  stats->maxTotalUs = MAX(stats->maxTotalUs, timing->lastByteUs);
+
+  bucket = histogramBucket(timing->lastByteUs);
+  if (entry->windowCount == HTTP_CLIENT_HISTOGRAM_WINDOW) {
+    stats->histogram[entry->window[entry->windowIndex]]--;
+  } else {
+    entry->windowCount++;
+  }
+  entry->window[entry->windowIndex] = (uint8_t)bucket;
+  entry->windowIndex = (entry->windowIndex + 1) % HTTP_CLIENT_HISTOGRAM_WINDOW;
+  stats->histogram[bucket]++;
+
+  k_mutex_unlock(&httpStatsLock);
+}
+
+// 0 once the deadline has passed
+static int32_t remainingMs(k_timepoint_t deadline) {
+  k_timeout_t timeout = sys_timepoint_timeout(deadline);
+
+  if (K_TIMEOUT_EQ(timeout, K_NO_WAIT)) {
+    return 0;
+  }
+
+  return (int32_t)k_ticks_to_ms_ceil32(timeout.ticks);
+}
+
+#ifdef CONFIG_DNS_RESOLVER
+static bool dnsCacheLookup(const char *host, struct in_addr *address) {
+  bool found = false;
+  uint32_t index = 0;
+  int64_t now = k_uptime_get();
+
+  k_mutex_lock(&httpDnsLock, K_FOREVER);
+  for (index = 0; index < ARRAY_SIZE(dnsCache); index++) {
+    if ((dnsCache[index].host[0] == '\0') || (strcmp(dnsCache[index].host, host) != 0)) {
+      continue;
+    }
+    if (dnsCache[index].expiryTime > now) {
+      *address = dnsCache[index].address;
+      found = true;
+    } else {
+      dnsCache[index].host[0] = '\0';
+    }
+    break;
+  }
+  k_mutex_unlock(&httpDnsLock);
+
+  return found;
+}
+
+static void dnsCacheStore(const char *host, const struct in_addr *address) {
+  uint32_t index = 0;
+  dns_cache_entry_t *entry = NULL;
+
+  if (strlen(host) >= HTTP_CLIENT_DNS_HOST_LENGTH) {
+    return;
+  }
+
+  // Same host, else a free entry, else the one expiring first
+  k_mutex_lock(&httpDnsLock, K_FOREVER);
+  for (index = 0; index < ARRAY_SIZE(dnsCache); index++) {
+    if (strcmp(dnsCache[index].host, host) == 0) {
+      entry = &dnsCache[index];
+      break;
+    }
+    if (!entry ||
+        ((entry->host[0] != '\0') &&
+         ((dnsCache[index].host[0] == '\0') || (dnsCache[index].expiryTime < entry->expiryTime)))) {
+      entry = &dnsCache[index];
+    }
+  }
+  strcpy(entry->host, host);
+  entry->address = *address;
+  entry->expiryTime = k_uptime_get() + (CONFIG_HTTP_CLIENT_DNS_CACHE_TTL_S * MSEC_PER_SEC);
+  k_mutex_unlock(&httpDnsLock);
+}
+
+static void dnsCacheInvalidate(const char *host) {
+  uint32_t index = 0;
+
+  k_mutex_lock(&httpDnsLock, K_FOREVER);
+  for (index = 0; index < ARRAY_SIZE(dnsCache); index++) {
+    if (strcmp(dnsCache[index].host, host) == 0) {
+      dnsCache[index].host[0] = '\0';
+    }
+  }
+  k_mutex_unlock(&httpDnsLock);
+}
+#endif // CONFIG_DNS_RESOLVER
+
+static uint32_t histogramBucket(uint32_t totalUs) {
+  uint32_t bucket = 0;
+
+  while ((bucket < ARRAY_SIZE(HTTP_CLIENT_HISTOGRAM_BOUNDS_MS)) &&
+         (totalUs >= (HTTP_CLIENT_HISTOGRAM_BOUNDS_MS[bucket] * USEC_PER_MSEC))) {
+    bucket++;
+  }
+
+  return bucket;
+}
+
+static int shellHttpStatsCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  uint32_t index = 0;
+  uint32_t bucket = 0;
+  uint32_t successes = 0;
+  uint32_t untracked = 0;
+  HttpEndpointStats stats = {0};
+
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  for (index = 0; HttpClient::getEndpointStats(index, &stats) == 0; index++) {
+    successes = MAX(stats.requests - stats.failures, 1);
+    shell_print(shell, "%s: %d requests, %d failed", stats.endpoint, stats.requests, stats.failures);
+    shell_print(shell, "  Bytes:         %lld sent, %lld received", stats.bytesSent, stats.bytesReceived);
+    shell_print(shell, "  Average (ms):  connect %lld, first byte %lld, total %lld, max %d",
+                stats.connectUs / successes / USEC_PER_MSEC,
+                stats.firstByteUs / successes / USEC_PER_MSEC,
+                stats.totalUs / successes / USEC_PER_MSEC,
+                stats.maxTotalUs / USEC_PER_MSEC);
+    // Network and server are both behind the first byte time, the transfer rate after it is the
+    // one to compare with the flash write rate
+    shell_print(shell, "  Throughput:    %lld bytes/s after the first byte",
+                (stats.bytesReceived * USEC_PER_SEC) / MAX(stats.transferUs, 1));
+    shell_print(shell, "  Last (ms):     resolve %d%s, socket %d, connect %d%s, sent %d, first byte %d, last byte %d (%d)",
+                stats.last.resolveUs / USEC_PER_MSEC,
+                stats.last.resolvedFromCache ? " (cached)" : "",
+                stats.last.socketUs / USEC_PER_MSEC,
+                stats.last.connectUs / USEC_PER_MSEC,
+                stats.last.reusedConnection ? " (reused)" : "",
+                stats.last.requestSentUs / USEC_PER_MSEC,
+                stats.last.firstByteUs / USEC_PER_MSEC,
+                stats.last.lastByteUs / USEC_PER_MSEC,
+                stats.last.result);
+    shell_fprintf(shell, SHELL_NORMAL, "  Last %d:", HTTP_CLIENT_HISTOGRAM_WINDOW);
+    for (bucket = 0; bucket < HTTP_CLIENT_HISTOGRAM_BUCKETS; bucket++) {
+      if (bucket < ARRAY_SIZE(HTTP_CLIENT_HISTOGRAM_BOUNDS_MS)) {
+        shell_fprintf(shell, SHELL_NORMAL, " <%dms:%d", HTTP_CLIENT_HISTOGRAM_BOUNDS_MS[bucket], stats.histogram[bucket]);
+      } else {
+        shell_fprintf(shell, SHELL_NORMAL, " more:%d", stats.histogram[bucket]);
+      }
+    }
+    shell_print(shell, "");
+  }
+  if (index == 0) {
+    shell_print(shell, "No request sent yet");
+  }
+
+  k_mutex_lock(&httpStatsLock, K_FOREVER);
+  untracked = httpUntrackedRequests;
+  k_mutex_unlock(&httpStatsLock);
+  if (untracked > 0) {
+    shell_warn(shell, "%d requests to other endpoints not tracked", untracked);
+  }
+
+  return 0;
+}
+
+static int shellHttpResetCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  HttpClient::resetStats();
+  shell_print(shell, "HTTP statistics cleared");
+
+  return 0;
+}
+
+static int shellHttpDnsCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+#ifdef CONFIG_DNS_RESOLVER
+  uint32_t index = 0;
+  int64_t now = 0;
+  char address[NET_IPV4_ADDR_LEN] = {0};
+  HttpDnsStats stats = {0};
+
+  if (argc > 1) {
+    if (strcmp(argv[1], "flush") != 0) {
+      shell_error(shell, "Unknown argument: %s", argv[1]);
+      return -EINVAL;
+    }
+    HttpClient::flushDnsCache();
+    shell_print(shell, "DNS cache flushed");
+    return 0;
+  }
+
+  HttpClient::getDnsStats(&stats);
+  shell_print(shell, "Cached:    %d resolutions, %lld us average", stats.hits, stats.hitUs / MAX(stats.hits, 1));
+  shell_print(shell, "Uncached:  %d resolutions, %lld us average", stats.misses, stats.missUs / MAX(stats.misses, 1));
+  shell_print(shell, "Failed:    %d resolutions", stats.failures);
+
+  k_mutex_lock(&httpDnsLock, K_FOREVER);
+  now = k_uptime_get();
+  for (index = 0; index < ARRAY_SIZE(dnsCache); index++) {
+    if ((dnsCache[index].host[0] == '\0') || (dnsCache[index].expiryTime <= now)) {
+      continue;
+    }
+    inet_ntop(AF_INET, &dnsCache[index].address, address, sizeof(address));
+    shell_print(shell, "  %-32s %-16s %lld s left",
+                dnsCache[index].host,
+                address,
+                (dnsCache[index].expiryTime - now) / MSEC_PER_SEC);
+  }
+  k_mutex_unlock(&httpDnsLock);
+#else
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  shell_print(shell, "DNS_RESOLVER is disabled, servers must be IPv4 addresses");
+#endif // CONFIG_DNS_RESOLVER
+
+  return 0;
+}
+
+#ifdef CONFIG_NET_SOCKETS_SOCKOPT_TLS
+static int shellHttpTlsCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  int ret = 0;
+  uint32_t round = 0;
+  uint16_t port = HTTP_CLIENT_TLS_DEFAULT_PORT;
+  sec_tag_t secTag = HTTP_CLIENT_TLS_DEFAULT_SEC_TAG;
+  HttpRequestTiming timing = {0};
+
+  if (argc > 2) {
+    port = (uint16_t)strtoul(argv[2], NULL, 10);
+  }
+  if (argc > 3) {
+    secTag = (sec_tag_t)strtoul(argv[3], NULL, 10);
+  }
+
+  // A new connection per request, keep-alive would hide the handshakes
+  HttpClient client(argv[1], port);
+  client.enableTls(secTag);
+
+  ret = HttpClient::flushTlsSessions();
+  if (ret < 0) {
+    shell_error(shell, "Failed to flush the TLS session cache (%d)", ret);
+    return ret;
+  }
+
+  for (round = 0; round < HTTP_CLIENT_TLS_BENCHMARK_ROUNDS; round++) {
+    ret = client.get("/", [](HttpResponse *response) {
+      ARG_UNUSED(response);
+    });
+    client.getLastTiming(&timing);
+    if (ret < 0) {
+      shell_error(shell, "Request %d failed (%d)", round + 1, ret);
+      return ret;
+    }
+    shell_print(shell, "%-8s handshake: %d ms (request total %d ms)",
+                (round == 0) ? "Full" : "Resumed",
+                (timing.connectUs - timing.socketUs) / USEC_PER_MSEC,
+                timing.lastByteUs / USEC_PER_MSEC);
+  }
+
+  return 0;
+}
+#endif // CONFIG_NET_SOCKETS_SOCKOPT_TLS
+
+static void httpWorkerThreadHandler(void *p1, void *p2, void *p3) {
+  HttpAsyncRequest *request = NULL;
+
+  ARG_UNUSED(p1);
+  ARG_UNUSED(p2);
+  ARG_UNUSED(p3);
+
+  while (true) {
+    request = static_cast<HttpAsyncRequest *>(k_fifo_get(&httpRequestQueue, K_FOREVER));
+    if (request && request->client) {
+      request->client->execute(request);
+    }
+  }
+}
+
+static int httpWorkersInit() {
+  uint32_t index = 0;
+
+  for (index = 0; index < CONFIG_HTTP_CLIENT_ASYNC_WORKERS; index++) {
+    k_thread_create(&httpWorkerThreads[index],
+                    httpWorkerStacks[index],
+                    K_THREAD_STACK_SIZEOF(httpWorkerStacks[index]),
+                    httpWorkerThreadHandler,
+                    NULL,
+                    NULL,
+                    NULL,
+                    K_PRIO_PREEMPT(7),
+                    0,
+                    K_NO_WAIT);
+    k_thread_name_set(&httpWorkerThreads[index], "httpWorker");
+  }
+
+  return 0;
 }
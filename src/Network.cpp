@@ -1,16 +1,83 @@
 // Lib C
+#include <string.h>
+#include <errno.h>
 #include <assert.h>
 
 // Zephyr includes
+#include <zephyr/kernel.h>
 #include <zephyr/net/net_core.h>
 #include <zephyr/net/net_context.h>
+#include <zephyr/net/net_ip.h>
+#include <zephyr/net/dhcpv4.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/net/ethernet.h>
+#include <zephyr/shell/shell.h>
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(Network);
 
 // User C++ class headers
 #include "Network.h"
+#include "BootTracer.h"
+#ifdef CONFIG_NETWORK_LEASE_CACHE
+#include "Storage.h"
+#endif // CONFIG_NETWORK_LEASE_CACHE
 
 static void netMgmtCallback(struct net_mgmt_event_callback *cb, uint32_t event, struct net_if *iface);
+static int shellNetworkStatusCommandHandler(const struct shell *shell, size_t argc, char **argv);
+#ifdef CONFIG_NETWORK_LEASE_CACHE
+static void leaseExpiryWorkHandler(struct k_work *work);
+static void leaseProbeWorkHandler(struct k_work *work);
+static void leaseSaveWorkHandler(struct k_work *work);
+static int shellNetworkForgetCommandHandler(const struct shell *shell, size_t argc, char **argv);
+#endif // CONFIG_NETWORK_LEASE_CACHE
+
+// Shell command registration
+#ifdef CONFIG_NETWORK_LEASE_CACHE
+SHELL_STATIC_SUBCMD_SET_CREATE(
+  networkSubcommands,
+  SHELL_CMD(status, NULL, "Link state, address and time needed to get it", shellNetworkStatusCommandHandler),
+  SHELL_CMD(forget, NULL, "Remove the lease saved in NVS, the next boot runs a full DHCP exchange", shellNetworkForgetCommandHandler),
+  SHELL_SUBCMD_SET_END
+);
+#else
+SHELL_STATIC_SUBCMD_SET_CREATE(
+  networkSubcommands,
+  SHELL_CMD(status, NULL, "Link state, address and time needed to get it", shellNetworkStatusCommandHandler),
+  SHELL_SUBCMD_SET_END
+);
+#endif // CONFIG_NETWORK_LEASE_CACHE
+SHELL_CMD_REGISTER(network, &networkSubcommands, "Network connectivity", NULL);
+
+// Guards the connectivity state, updated from the net_mgmt thread and read from the shell
+K_MUTEX_DEFINE(networkMutex);
+
+#ifdef CONFIG_NETWORK_LEASE_CACHE
+// Sends the ARP probe for the cached address, then collects the answers once the probe wait is over
+K_WORK_DELAYABLE_DEFINE(leaseProbeWork, leaseProbeWorkHandler);
+// Drops the cached address if the DHCP client hasn't bound a lease within the grace period
+K_WORK_DELAYABLE_DEFINE(leaseExpiryWork, leaseExpiryWorkHandler);
+// Keeps the remaining time saved in NVS close to the actual one while the lease is bound
+K_WORK_DELAYABLE_DEFINE(leaseSaveWork, leaseSaveWorkHandler);
+
+// Ethernet frame of an ARP packet for IPv4, as sent and received on the packet socket
+typedef struct __packed {
+  uint8_t destination[NET_ETH_ADDR_LEN];
+  uint8_t source[NET_ETH_ADDR_LEN];
+  uint16_t etherType;
+  uint16_t hardwareType;
+  uint16_t protocolType;
+  uint8_t hardwareLength;
+  uint8_t protocolLength;
+  uint16_t operation;
+  uint8_t senderMac[NET_ETH_ADDR_LEN];
+  uint8_t senderIp[sizeof(struct in_addr)];
+  uint8_t targetMac[NET_ETH_ADDR_LEN];
+  uint8_t targetIp[sizeof(struct in_addr)];
+} arp_frame_t;
+
+static constexpr uint16_t ARP_HARDWARE_ETHERNET = 1;
+static constexpr uint16_t ARP_OPERATION_REQUEST = 1;
+#endif // CONFIG_NETWORK_LEASE_CACHE
 
 // Define the static member
 Network Network::instance;
@@ -21,8 +88,26 @@ Network& Network::getInstance() {
 }
 
 Network::Network() {
-  net_mgmt_init_event_callback(&this->mgmtEventCb, netMgmtCallback, NET_EVENT_IPV4_ADDR_ADD);
+  this->address.s_addr = INADDR_ANY;
+  this->connectStartTime = 0;
+  this->leaseBound = false;
+  memset(&this->stats, 0x00, sizeof(this->stats));
+#ifdef CONFIG_NETWORK_LEASE_CACHE
+  memset(&this->cachedLease, 0x00, sizeof(this->cachedLease));
+  this->cachedLeasePending = false;
+  this->cachedLeaseApplied = false;
+  this->leaseProbeSock = -1;
+  this->leaseBoundTime = 0;
+  this->leaseTimeS = 0;
+#endif // CONFIG_NETWORK_LEASE_CACHE
+
+  // Events of different layers need their own callback
+  net_mgmt_init_event_callback(&this->mgmtEventCb,
+                               netMgmtCallback,
+                               NET_EVENT_IPV4_ADDR_ADD | NET_EVENT_IPV4_ADDR_DEL | NET_EVENT_IPV4_DHCP_BOUND);
   net_mgmt_add_event_callback(&this->mgmtEventCb);
+  net_mgmt_init_event_callback(&this->linkEventCb, netMgmtCallback, NET_EVENT_IF_UP | NET_EVENT_IF_DOWN);
+  net_mgmt_add_event_callback(&this->linkEventCb);
   this->netIface = net_if_get_default();
 }
 
@@ -30,31 +115,506 @@ Network::~Network() {
 }
 
 void Network::start() {
+  BootTracer::getInstance().mark(BootMilestone::NETWORK_STARTED);
+
+  k_mutex_lock(&networkMutex, K_FOREVER);
+  this->stats.linkUp = net_if_is_up(this->netIface);
+  this->connectStartTime = k_uptime_get();
+  k_mutex_unlock(&networkMutex);
+
+#ifdef CONFIG_NETWORK_LEASE_CACHE
+  // Zephyr's DHCP client always starts from a DISCOVER after a random delay of up to 10 s, the saved
+  // address is usable once the link is up and nobody answered its ARP probe, while the client gets
+  // the lease confirmed
+  this->loadLease();
+  this->probeLease();
+#endif // CONFIG_NETWORK_LEASE_CACHE
   net_dhcpv4_start(this->netIface);
 }
 
-void Network::onGotIP(std::function<void(const char *)> callback) {
+void Network::onGotIP(InplaceFunction<void(const char *)> callback) {
   assert(callback);
 
   this->callback = callback;
 }
 
-static void netMgmtCallback(struct net_mgmt_event_callback *cb, uint32_t event, struct net_if *iface) {
-  char ipBuffer[NET_IPV4_ADDR_LEN] = {0};
+void Network::onLost(InplaceFunction<void()> callback) {
+  assert(callback);
+
+  this->lostCallback = callback;
+}
+
+void Network::getStats(network_stats_t *stats) {
+  assert(stats);
+
+  k_mutex_lock(&networkMutex, K_FOREVER);
+  *stats = this->stats;
+  stats->address = this->address;
+  k_mutex_unlock(&networkMutex);
+}
+
+void Network::onEvent(uint32_t event, struct net_if *iface) {
+  struct in_addr address = {0};
+
+  switch (event) {
+    case NET_EVENT_IF_UP: {
+      LOG_INF("Link up");
+      k_mutex_lock(&networkMutex, K_FOREVER);
+      this->stats.linkUp = true;
+      this->connectStartTime = k_uptime_get();
+      this->leaseBound = false;
+      k_mutex_unlock(&networkMutex);
+      // The DHCP client asks for its lease again by itself, an address still held is usable right away
+      this->setConnected(iface);
+#ifdef CONFIG_NETWORK_LEASE_CACHE
+      this->probeLease();
+#endif // CONFIG_NETWORK_LEASE_CACHE
+      break;
+    }
 
-  if (event == NET_EVENT_IPV4_ADDR_ADD) {
-    if (iface->config.ip.ipv4->unicast[0].addr_type == NET_ADDR_DHCP) {
-      if (net_addr_ntop(AF_INET,
-                        &iface->config.ip.ipv4->unicast[0].address.in_addr,
-                        ipBuffer,
-                        sizeof(ipBuffer))) {
-        // Notify the callback if it's set
-        if (Network::getInstance().callback) {
-          Network::getInstance().callback(ipBuffer);
-        }
+    case NET_EVENT_IF_DOWN: {
+      k_mutex_lock(&networkMutex, K_FOREVER);
+      this->stats.linkUp = false;
+      this->stats.linkDowns++;
+      k_mutex_unlock(&networkMutex);
+      this->setDisconnected("link down");
+      break;
+    }
+
+    case NET_EVENT_IPV4_DHCP_BOUND: {
+      k_mutex_lock(&networkMutex, K_FOREVER);
+      if (!this->leaseBound) {
+        this->leaseBound = true;
+        this->stats.timeToLeaseMs = (uint32_t)(k_uptime_get() - this->connectStartTime);
+      }
+      k_mutex_unlock(&networkMutex);
+#ifdef CONFIG_NETWORK_LEASE_CACHE
+      this->onLeaseBound(iface);
+#endif // CONFIG_NETWORK_LEASE_CACHE
+      // A lease bound for an address that was already there doesn't add it again
+      this->setConnected(iface);
+      break;
+    }
+
+    case NET_EVENT_IPV4_ADDR_ADD: {
+      this->setConnected(iface);
+      break;
+    }
+
+    case NET_EVENT_IPV4_ADDR_DEL: {
+      if (this->findAddress(iface, &address)) {
+        // A cached address replaced by the one of the lease
+        this->setConnected(iface);
       } else {
-        LOG_ERR("Error while converting IP address to string form\r\n");
+        k_mutex_lock(&networkMutex, K_FOREVER);
+        this->stats.addressLosses += this->stats.connected ? 1 : 0;
+        this->leaseBound = false;
+        k_mutex_unlock(&networkMutex);
+        this->setDisconnected("address lost");
       }
+      break;
+    }
+
+    default: {
+      break;
+    }
+  }
+}
+
+bool Network::findAddress(struct net_if *iface, struct in_addr *address) {
+  struct net_if_ipv4 *ipv4 = iface->config.ip.ipv4;
+  size_t index = 0;
+  bool found = false;
+
+  if (!ipv4) {
+    return false;
+  }
+
+  for (index = 0; index < NET_IF_MAX_IPV4_ADDR; index++) {
+    if (!ipv4->unicast[index].is_used || (ipv4->unicast[index].addr_type != NET_ADDR_DHCP)) {
+      continue;
+    }
+    *address = ipv4->unicast[index].address.in_addr;
+    found = true;
+    // The address of the lease wins over a cached one that isn't removed yet
+    if (net_ipv4_addr_cmp(address, &iface->config.dhcpv4.requested_ip)) {
+      break;
+    }
+  }
+
+  return found;
+}
+
+void Network::setConnected(struct net_if *iface) {
+  char ipBuffer[NET_IPV4_ADDR_LEN] = {0};
+  struct in_addr address = {0};
+  bool changed = false;
+  uint32_t elapsedTime = 0;
+
+  if (!this->findAddress(iface, &address)) {
+    return;
+  }
+
+  k_mutex_lock(&networkMutex, K_FOREVER);
+  if (this->stats.linkUp) {
+    changed = !this->stats.connected || !net_ipv4_addr_cmp(&this->address, &address);
+    if (!this->stats.connected) {
+      this->stats.timeToIpMs = (uint32_t)(k_uptime_get() - this->connectStartTime);
+    }
+    this->stats.connected = true;
+    this->address = address;
+    elapsedTime = this->stats.timeToIpMs;
+  }
+  k_mutex_unlock(&networkMutex);
+
+  if (!changed) {
+    return;
+  }
+
+  BootTracer::getInstance().mark(BootMilestone::GOT_IP);
+  if (net_addr_ntop(AF_INET, &address, ipBuffer, sizeof(ipBuffer))) {
+    LOG_INF("Got IP address %s in %d ms", ipBuffer, elapsedTime);
+    // Notify the callback if it's set
+    if (this->callback) {
+      this->callback(ipBuffer);
+    }
+  } else {
+    LOG_ERR("Error while converting IP address to string form\r\n");
+  }
+}
+
+void Network::setDisconnected(const char *reason) {
+  bool wasConnected = false;
+
+  k_mutex_lock(&networkMutex, K_FOREVER);
+  wasConnected = this->stats.connected;
+  this->stats.connected = false;
+  k_mutex_unlock(&networkMutex);
+
+  if (!wasConnected) {
+    return;
+  }
+
+  LOG_WRN("Network lost (%s)", reason);
+  if (this->lostCallback) {
+    this->lostCallback();
+  }
+}
+
+#ifdef CONFIG_NETWORK_LEASE_CACHE
+int Network::forgetLease() {
+  return Storage::getInstance().remove(STORAGE_ID_NETWORK_LEASE);
+}
+
+void Network::onCachedLeaseExpired() {
+  char ipBuffer[NET_IPV4_ADDR_LEN] = {0};
+  bool bound = false;
+
+  k_mutex_lock(&networkMutex, K_FOREVER);
+  bound = this->leaseBound;
+  k_mutex_unlock(&networkMutex);
+  if (bound || !this->cachedLeaseApplied) {
+    return;
+  }
+
+  this->cachedLeaseApplied = false;
+  LOG_WRN("Cached lease of %s not confirmed by the DHCP server in time, dropping it",
+          net_addr_ntop(AF_INET, &this->cachedLease.address, ipBuffer, sizeof(ipBuffer)));
+  net_if_ipv4_addr_rm(this->netIface, &this->cachedLease.address);
+}
+
+void Network::loadLease() {
+  ssize_t ret = 0;
+
+  ret = Storage::getInstance().read(STORAGE_ID_NETWORK_LEASE, &this->cachedLease, sizeof(this->cachedLease));
+  if ((ret != (ssize_t)sizeof(this->cachedLease)) ||
+      (this->cachedLease.address.s_addr == INADDR_ANY) ||
+      (this->cachedLease.remainingS == 0)) {
+    if (ret != -ENOENT) {
+      LOG_WRN("No usable lease saved (%d)", (int)ret);
+    }
+    memset(&this->cachedLease, 0x00, sizeof(this->cachedLease));
+    return;
+  }
+
+  this->cachedLeasePending = true;
+}
+
+// Called when the network starts and on link up, does nothing unless a cached lease waits for the link
+void Network::probeLease() {
+  bool linkUp = false;
+
+  k_mutex_lock(&networkMutex, K_FOREVER);
+  linkUp = this->stats.linkUp;
+  k_mutex_unlock(&networkMutex);
+
+  if (this->cachedLeasePending && linkUp) {
+    k_work_reschedule(&leaseProbeWork, K_NO_WAIT);
+  }
+}
+
+// Runs twice on the system workqueue: first to send the probe, then to read the answers. Neither
+// step blocks, the socket is only read once the probe wait is over
+void Network::onLeaseProbeWork() {
+  int ret = 0;
+  bool bound = false;
+  bool linkUp = false;
+  char ipBuffer[NET_IPV4_ADDR_LEN] = {0};
+  struct net_linkaddr *linkAddress = net_if_get_link_addr(this->netIface);
+  struct sockaddr_ll socketAddress = {0};
+  arp_frame_t frame = {0};
+
+  k_mutex_lock(&networkMutex, K_FOREVER);
+  bound = this->leaseBound;
+  linkUp = this->stats.linkUp;
+  k_mutex_unlock(&networkMutex);
+
+  // 0. Nothing left to check once the DHCP client bound a lease, probe again on the next link up if
+  // the link went down meanwhile
+  if (!this->cachedLeasePending || bound || !linkUp) {
+    if (this->leaseProbeSock >= 0) {
+      close(this->leaseProbeSock);
+      this->leaseProbeSock = -1;
+    }
+    this->cachedLeasePending = this->cachedLeasePending && !bound;
+    return;
+  }
+
+  // 2. Probe wait is over, the address is only applied if no other host claimed it
+  if (this->leaseProbeSock >= 0) {
+    if (this->leaseProbeAnswered()) {
+      LOG_WRN("Cached address %s is used by another host, waiting for the DHCP server",
+              net_addr_ntop(AF_INET, &this->cachedLease.address, ipBuffer, sizeof(ipBuffer)));
+      this->forgetLease();
+    } else {
+      this->reuseLease();
+    }
+    close(this->leaseProbeSock);
+    this->leaseProbeSock = -1;
+    this->cachedLeasePending = false;
+    return;
+  }
+
+  // 1. Send an ARP probe: a request for the cached address with an unspecified sender address, so
+  // that the other hosts don't update their ARP cache with it (RFC 5227)
+  this->leaseProbeSock = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+  if (this->leaseProbeSock < 0) {
+    LOG_WRN("Failed to create the ARP probe socket (%d), not reusing the cached lease", -errno);
+    this->cachedLeasePending = false;
+    return;
+  }
+  socketAddress.sll_family = AF_PACKET;
+  socketAddress.sll_protocol = htons(ETH_P_ALL);
+  socketAddress.sll_ifindex = net_if_get_by_iface(this->netIface);
+  ret = bind(this->leaseProbeSock, (struct sockaddr *)&socketAddress, sizeof(socketAddress));
+  if (ret == 0) {
+    memset(frame.destination, 0xff, sizeof(frame.destination));
+    memcpy(frame.source, linkAddress->addr, sizeof(frame.source));
+    frame.etherType = htons(NET_ETH_PTYPE_ARP);
+    frame.hardwareType = htons(ARP_HARDWARE_ETHERNET);
+    frame.protocolType = htons(NET_ETH_PTYPE_IP);
+    frame.hardwareLength = NET_ETH_ADDR_LEN;
+    frame.protocolLength = sizeof(struct in_addr);
+    frame.operation = htons(ARP_OPERATION_REQUEST);
+    memcpy(frame.senderMac, linkAddress->addr, sizeof(frame.senderMac));
+    memcpy(frame.targetIp, &this->cachedLease.address, sizeof(frame.targetIp));
+
+    socketAddress.sll_protocol = htons(NET_ETH_PTYPE_ARP);
+    socketAddress.sll_halen = NET_ETH_ADDR_LEN;
+    memset(socketAddress.sll_addr, 0xff, NET_ETH_ADDR_LEN);
+    ret = sendto(this->leaseProbeSock,
+                 &frame,
+                 sizeof(frame),
+                 0,
+                 (struct sockaddr *)&socketAddress,
+                 sizeof(socketAddress));
+  }
+  if (ret < 0) {
+    LOG_WRN("Failed to send the ARP probe (%d), not reusing the cached lease", -errno);
+    close(this->leaseProbeSock);
+    this->leaseProbeSock = -1;
+    this->cachedLeasePending = false;
+    return;
+  }
+
+  k_work_reschedule(&leaseProbeWork, K_MSEC(CONFIG_NETWORK_LEASE_PROBE_WAIT_MS));
+}
+
+// Any ARP packet sent from the address by another host, or another host probing for it too
+bool Network::leaseProbeAnswered() {
+  ssize_t length = 0;
+  struct net_linkaddr *linkAddress = net_if_get_link_addr(this->netIface);
+  static const uint8_t unspecifiedIp[sizeof(struct in_addr)] = {0};
+  arp_frame_t frame = {0};
+
+  while ((length = recv(this->leaseProbeSock, &frame, sizeof(frame), MSG_DONTWAIT)) > 0) {
+    if ((length < (ssize_t)sizeof(frame)) ||
+        (frame.etherType != htons(NET_ETH_PTYPE_ARP)) ||
+        (frame.protocolType != htons(NET_ETH_PTYPE_IP)) ||
+        (memcmp(frame.senderMac, linkAddress->addr, sizeof(frame.senderMac)) == 0)) {
+      continue;
+    }
+    if (memcmp(frame.senderIp, &this->cachedLease.address, sizeof(frame.senderIp)) == 0) {
+      return true;
     }
+    if ((frame.operation == htons(ARP_OPERATION_REQUEST)) &&
+        (memcmp(frame.senderIp, unspecifiedIp, sizeof(frame.senderIp)) == 0) &&
+        (memcmp(frame.targetIp, &this->cachedLease.address, sizeof(frame.targetIp)) == 0)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void Network::reuseLease() {
+  char ipBuffer[NET_IPV4_ADDR_LEN] = {0};
+  uint32_t graceS = 0;
+
+  // Added like a DHCP address so that the client removes it if the lease it gets is for another one,
+  // or if the server NAKs its request for it
+  if (!net_if_ipv4_addr_add(this->netIface, &this->cachedLease.address, NET_ADDR_DHCP, 0)) {
+    LOG_WRN("Failed to add the cached address");
+    return;
+  }
+  net_if_ipv4_set_netmask(this->netIface, &this->cachedLease.netmask);
+  net_if_ipv4_set_gw(this->netIface, &this->cachedLease.gateway);
+  this->cachedLeaseApplied = true;
+
+  // The time spent powered off is unknown, the saved remaining time is only an upper bound. The
+  // address is only used unconfirmed for as long as the first DHCP exchange should take
+  graceS = MIN(this->cachedLease.remainingS, (uint32_t)CONFIG_NETWORK_LEASE_GRACE_S);
+  k_work_schedule(&leaseExpiryWork, K_SECONDS(graceS));
+
+  k_mutex_lock(&networkMutex, K_FOREVER);
+  this->stats.leaseReused = true;
+  k_mutex_unlock(&networkMutex);
+
+  LOG_INF("Reusing the lease of %s for up to %d s until the DHCP server confirms it",
+          net_addr_ntop(AF_INET, &this->cachedLease.address, ipBuffer, sizeof(ipBuffer)),
+          graceS);
+}
+
+void Network::onLeaseBound(struct net_if *iface) {
+  network_lease_t lease = {0};
+  struct k_work_sync sync;
+
+  lease.address = iface->config.dhcpv4.requested_ip;
+  lease.server = iface->config.dhcpv4.server_id;
+  lease.netmask = iface->config.ip.ipv4->netmask;
+  lease.gateway = iface->config.ip.ipv4->gw;
+  lease.remainingS = iface->config.dhcpv4.lease_time;
+
+  // A probe still running is stopped for good, the lease it checks is replaced below
+  k_work_cancel_delayable_sync(&leaseProbeWork, &sync);
+  if (this->leaseProbeSock >= 0) {
+    close(this->leaseProbeSock);
+    this->leaseProbeSock = -1;
+  }
+  this->cachedLeasePending = false;
+
+  k_work_cancel_delayable(&leaseExpiryWork);
+  if (this->cachedLeaseApplied && !net_ipv4_addr_cmp(&this->cachedLease.address, &lease.address)) {
+    LOG_WRN("The DHCP server handed out another address, dropping the cached one");
+    net_if_ipv4_addr_rm(iface, &this->cachedLease.address);
+  }
+  this->cachedLeaseApplied = false;
+
+  k_mutex_lock(&networkMutex, K_FOREVER);
+  this->cachedLease = lease;
+  this->leaseTimeS = lease.remainingS;
+  this->leaseBoundTime = k_uptime_get();
+  k_mutex_unlock(&networkMutex);
+
+  this->saveLease();
+}
+
+void Network::saveLease() {
+  network_lease_t lease = {0};
+  ssize_t ret = 0;
+  uint32_t elapsedS = 0;
+  bool bound = false;
+
+  k_mutex_lock(&networkMutex, K_FOREVER);
+  bound = this->leaseBound;
+  lease = this->cachedLease;
+  elapsedS = (uint32_t)((k_uptime_get() - this->leaseBoundTime) / MSEC_PER_SEC);
+  lease.remainingS = (elapsedS < this->leaseTimeS) ? (this->leaseTimeS - elapsedS) : 0;
+  k_mutex_unlock(&networkMutex);
+
+  // Once the lease is lost, the last remaining time saved is still an upper bound
+  if (!bound) {
+    return;
+  }
+
+  ret = Storage::getInstance().write(STORAGE_ID_NETWORK_LEASE, &lease, sizeof(lease));
+  if (ret < 0) {
+    LOG_WRN("Failed to save the lease (%d)", (int)ret);
+  }
+  if (lease.remainingS > 0) {
+    k_work_reschedule(&leaseSaveWork, K_SECONDS(MIN(lease.remainingS, (uint32_t)CONFIG_NETWORK_LEASE_SAVE_PERIOD_S)));
+  }
+}
+
+static void leaseExpiryWorkHandler(struct k_work *work) {
+  ARG_UNUSED(work);
+
+  Network::getInstance().onCachedLeaseExpired();
+}
+
+static void leaseProbeWorkHandler(struct k_work *work) {
+  ARG_UNUSED(work);
+
+  Network::getInstance().onLeaseProbeWork();
+}
+
+static void leaseSaveWorkHandler(struct k_work *work) {
+  ARG_UNUSED(work);
+
+  Network::getInstance().saveLease();
+}
+#endif // CONFIG_NETWORK_LEASE_CACHE
+
+static void netMgmtCallback(struct net_mgmt_event_callback *cb, uint32_t event, struct net_if *iface) {
+  ARG_UNUSED(cb);
+
+  Network::getInstance().onEvent(event, iface);
+}
+
+static int shellNetworkStatusCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  network_stats_t stats = {0};
+  char ipBuffer[NET_IPV4_ADDR_LEN] = {0};
+
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  Network::getInstance().getStats(&stats);
+
+  shell_print(shell, "Link:           %s (%d times down)", stats.linkUp ? "up" : "down", stats.linkDowns);
+  shell_print(shell, "Address:        %s%s",
+              stats.connected ? net_addr_ntop(AF_INET, &stats.address, ipBuffer, sizeof(ipBuffer)) : "none",
+              stats.leaseReused ? " (cached lease reused at boot)" : "");
+  shell_print(shell, "Address losses: %d", stats.addressLosses);
+  shell_print(shell, "Time to IP:     %d ms", stats.timeToIpMs);
+  shell_print(shell, "Time to lease:  %d ms", stats.timeToLeaseMs);
+
+  return 0;
+}
+
+#ifdef CONFIG_NETWORK_LEASE_CACHE
+static int shellNetworkForgetCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  int ret = 0;
+
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  ret = Network::getInstance().forgetLease();
+  if ((ret < 0) && (ret != -ENOENT)) {
+    shell_error(shell, "Failed to remove the saved lease (%d)", ret);
+    return ret;
   }
-}
\ No newline at end of file
+  shell_print(shell, "Saved lease removed");
+
+  return 0;
+}
+#endif // CONFIG_NETWORK_LEASE_CACHE
@@ -0,0 +1,151 @@
+// Lib C
+#include <string.h>
+#include <assert.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/shell/shell.h>
+#ifdef CONFIG_PM
+#include <zephyr/pm/pm.h>
+#endif // CONFIG_PM
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(PowerMonitor);
+
+// User C++ class headers
+#include "PowerMonitor.h"
+
+typedef struct {
+  uint64_t cycles;
+  uint64_t windows;
+} idle_stats_t;
+
+static void idleThreadStatsCallback(const struct k_thread *thread, void *userData);
+static int shellPowerCommandHandler(const struct shell *shell, size_t argc, char **argv);
+
+#ifdef CONFIG_PM
+static void lowPowerStateEntry(enum pm_state state);
+static void lowPowerStateExit(enum pm_state state);
+
+// Called from the idle thread with interrupts locked, around each low-power state
+static struct pm_notifier powerNotifier = {
+  .state_entry = lowPowerStateEntry,
+  .state_exit = lowPowerStateExit,
+};
+#endif // CONFIG_PM
+
+// Shell command registration
+SHELL_CMD_REGISTER(power, NULL, "Show idle time and wakeups since boot and since the last call", shellPowerCommandHandler);
+
+// Define the static member
+PowerMonitor PowerMonitor::instance;
+
+PowerMonitor& PowerMonitor::getInstance() {
+  // Return the singleton instance
+  return instance;
+}
+
+PowerMonitor::PowerMonitor() {
+  this->lowPowerEntries = 0;
+  this->lowPowerEntryCycles = 0;
+  this->lowPowerCycles = 0;
+#ifdef CONFIG_PM
+  pm_notifier_register(&powerNotifier);
+#endif // CONFIG_PM
+}
+
+PowerMonitor::~PowerMonitor() {
+#ifdef CONFIG_PM
+  pm_notifier_unregister(&powerNotifier);
+#endif // CONFIG_PM
+}
+
+void PowerMonitor::getStats(power_stats_t *stats) {
+  unsigned int key = 0;
+  idle_stats_t idleStats = {0};
+
+  assert(stats);
+
+  // Sum the idle threads, there is one per CPU
+  k_thread_foreach(idleThreadStatsCallback, &idleStats);
+
+  stats->uptimeUs = (uint64_t)k_uptime_get() * USEC_PER_MSEC;
+  stats->idleUs = k_cyc_to_us_floor64(idleStats.cycles);
+  // The idle thread is scheduled back in after every wakeup that found something to do
+  stats->idleWakeups = idleStats.windows;
+
+  key = irq_lock();
+  stats->lowPowerEntries = this->lowPowerEntries;
+  stats->lowPowerUs = k_cyc_to_us_floor64(this->lowPowerCycles);
+  irq_unlock(key);
+}
+
+void PowerMonitor::onLowPowerEntry() {
+  this->lowPowerEntries++;
+  this->lowPowerEntryCycles = k_cycle_get_32();
+}
+
+void PowerMonitor::onLowPowerExit() {
+  this->lowPowerCycles += k_cycle_get_32() - this->lowPowerEntryCycles;
+}
+
+static void idleThreadStatsCallback(const struct k_thread *thread, void *userData) {
+  idle_stats_t *idleStats = static_cast<idle_stats_t *>(userData);
+  k_thread_runtime_stats_t threadStats = {0};
+
+  if (k_thread_priority_get((k_tid_t)thread) != K_IDLE_PRIO) {
+    return;
+  }
+
+  if (k_thread_runtime_stats_get((k_tid_t)thread, &threadStats) == 0) {
+    idleStats->cycles += threadStats.execution_cycles;
+  }
+  // The number of scheduling windows isn't part of k_thread_runtime_stats_t
+  idleStats->windows += thread->base.usage.num_windows;
+}
+
+#ifdef CONFIG_PM
+static void lowPowerStateEntry(enum pm_state state) {
+  ARG_UNUSED(state);
+
+  PowerMonitor::getInstance().onLowPowerEntry();
+}
+
+static void lowPowerStateExit(enum pm_state state) {
+  ARG_UNUSED(state);
+
+  PowerMonitor::getInstance().onLowPowerExit();
+}
+#endif // CONFIG_PM
+
+static int shellPowerCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  static power_stats_t previous = {0};
+  power_stats_t current = {0};
+  power_stats_t delta = {0};
+  uint64_t periodMs = 0;
+
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  PowerMonitor::getInstance().getStats(&current);
+  delta.uptimeUs = current.uptimeUs - previous.uptimeUs;
+  delta.idleUs = current.idleUs - previous.idleUs;
+  delta.idleWakeups = current.idleWakeups - previous.idleWakeups;
+  delta.lowPowerEntries = current.lowPowerEntries - previous.lowPowerEntries;
+  delta.lowPowerUs = current.lowPowerUs - previous.lowPowerUs;
+  memcpy(&previous, &current, sizeof(previous));
+
+  periodMs = MAX(delta.uptimeUs / USEC_PER_MSEC, 1);
+  shell_print(shell, "Over the last %lld ms:", periodMs);
+  shell_print(shell, "  Idle:                    %lld%%", (delta.idleUs * 100) / MAX(delta.uptimeUs, 1));
+  shell_print(shell, "  Idle wakeups per minute: %lld", (delta.idleWakeups * 60 * MSEC_PER_SEC) / periodMs);
+#ifdef CONFIG_PM
+  shell_print(shell, "  Low-power entries:       %d (%lld ms)", delta.lowPowerEntries, delta.lowPowerUs / USEC_PER_MSEC);
+#endif // CONFIG_PM
+  shell_print(shell, "Since boot: idle %lld ms of %lld ms, %lld idle wakeups",
+              current.idleUs / USEC_PER_MSEC,
+              current.uptimeUs / USEC_PER_MSEC,
+              current.idleWakeups);
+
+  return 0;
+}
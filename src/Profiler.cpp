@@ -0,0 +1,249 @@
+// Lib C
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#if defined(CONFIG_NEWLIB_LIBC) || defined(CONFIG_PICOLIBC)
+#include <malloc.h>
+#endif // CONFIG_NEWLIB_LIBC || CONFIG_PICOLIBC
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/sys/sys_heap.h>
+#include <zephyr/zbus/zbus.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(Profiler);
+
+// User C++ class headers
+#include "EventManager.h"
+
+static constexpr uint32_t PROFILER_MAX_THREADS = 24;
+static constexpr uint32_t PROFILER_DEFAULT_SAMPLE_PERIOD_S = 5;
+// Stacks used above this share are flagged
+static constexpr uint32_t PROFILER_STACK_WARNING_PERCENT = 90;
+
+typedef struct {
+  const struct k_thread *thread;
+  char name[CONFIG_THREAD_MAX_NAME_LEN];
+  int priority;
+  uint64_t cycles;
+  size_t stackSize;
+  size_t stackUsed;
+} thread_sample_t;
+
+typedef struct {
+  thread_sample_t threads[PROFILER_MAX_THREADS];
+  uint32_t threadCount;
+  uint32_t missedThreads;
+  uint64_t totalCycles;
+  event_channel_stats_t channels[3];
+} profiler_snapshot_t;
+
+#if defined(CONFIG_HEAP_MEM_POOL_SIZE) && (CONFIG_HEAP_MEM_POOL_SIZE > 0)
+// Heap behind k_malloc(), not exported by the kernel headers
+extern struct k_heap _system_heap;
+#endif // CONFIG_HEAP_MEM_POOL_SIZE
+
+static void takeSnapshot(profiler_snapshot_t *snapshot);
+static void threadSnapshotCallback(const struct k_thread *thread, void *userData);
+static const thread_sample_t *findThread(const profiler_snapshot_t *snapshot, const struct k_thread *thread);
+static int shellPerfThreadsCommandHandler(const struct shell *shell, size_t argc, char **argv);
+static int shellPerfHeapCommandHandler(const struct shell *shell, size_t argc, char **argv);
+static int shellPerfChannelsCommandHandler(const struct shell *shell, size_t argc, char **argv);
+static int shellPerfSampleCommandHandler(const struct shell *shell, size_t argc, char **argv);
+
+// Shell command registration
+SHELL_STATIC_SUBCMD_SET_CREATE(
+  perfSubcommands,
+  SHELL_CMD(threads, NULL, "CPU share since boot and stack high-water mark of every thread", shellPerfThreadsCommandHandler),
+  SHELL_CMD(heap, NULL, "Heap usage", shellPerfHeapCommandHandler),
+  SHELL_CMD(channels, NULL, "Events published on each channel", shellPerfChannelsCommandHandler),
+  SHELL_CMD_ARG(sample, NULL, "CPU share and events published over [seconds]", shellPerfSampleCommandHandler, 1, 1),
+  SHELL_SUBCMD_SET_END
+);
+SHELL_CMD_REGISTER(perf, &perfSubcommands, "Runtime profiler", NULL);
+
+// Snapshots are large, only the shell thread takes them
+static profiler_snapshot_t firstSnapshot;
+static profiler_snapshot_t secondSnapshot;
+
+static const struct zbus_channel *const eventChannels[] = {&networkChannel, &buttonChannel, &otaChannel};
+
+BUILD_ASSERT(ARRAY_SIZE(eventChannels) == ARRAY_SIZE(firstSnapshot.channels), "Channel list mismatch");
+
+static void takeSnapshot(profiler_snapshot_t *snapshot) {
+  uint32_t index = 0;
+
+  assert(snapshot);
+
+  memset(snapshot, 0x00, sizeof(*snapshot));
+
+  // Unlocked, threads are scanned for their stack usage and that takes a while
+  k_thread_foreach_unlocked(threadSnapshotCallback, snapshot);
+
+  for (index = 0; index < ARRAY_SIZE(eventChannels); index++) {
+    getChannelStats(eventChannels[index], &snapshot->channels[index]);
+  }
+}
+
+static void threadSnapshotCallback(const struct k_thread *thread, void *userData) {
+  profiler_snapshot_t *snapshot = static_cast<profiler_snapshot_t *>(userData);
+  thread_sample_t *sample = NULL;
+  const char *name = NULL;
+  size_t unused = 0;
+  k_thread_runtime_stats_t stats = {0};
+
+  if (k_thread_runtime_stats_get((k_tid_t)thread, &stats) == 0) {
+    snapshot->totalCycles += stats.execution_cycles;
+  }
+
+  if (snapshot->threadCount >= PROFILER_MAX_THREADS) {
+    snapshot->missedThreads++;
+    return;
+  }
+
+  sample = &snapshot->threads[snapshot->threadCount++];
+  sample->thread = thread;
+  name = k_thread_name_get((k_tid_t)thread);
+  strncpy(sample->name, ((name != NULL) && (name[0] != '\0')) ? name : "unnamed", sizeof(sample->name) - 1);
+  sample->priority = k_thread_priority_get((k_tid_t)thread);
+  sample->cycles = stats.execution_cycles;
+  sample->stackSize = thread->stack_info.size;
+  if (k_thread_stack_space_get(thread, &unused) == 0) {
+    sample->stackUsed = sample->stackSize - unused;
+  }
+}
+
+static const thread_sample_t *findThread(const profiler_snapshot_t *snapshot, const struct k_thread *thread) {
+  uint32_t index = 0;
+
+  for (index = 0; index < snapshot->threadCount; index++) {
+    if (snapshot->threads[index].thread == thread) {
+      return &snapshot->threads[index];
+    }
+  }
+
+  return NULL;
+}
+
+static int shellPerfThreadsCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  uint32_t index = 0;
+  uint32_t stackPercent = 0;
+  const thread_sample_t *sample = NULL;
+
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  takeSnapshot(&firstSnapshot);
+
+  shell_print(shell, "%-24s %4s %6s %14s", "Thread", "Prio", "CPU", "Stack used");
+  for (index = 0; index < firstSnapshot.threadCount; index++) {
+    sample = &firstSnapshot.threads[index];
+    stackPercent = sample->stackSize ? (uint32_t)((sample->stackUsed * 100) / sample->stackSize) : 0;
+    shell_print(shell, "%-24s %4d %5d%% %6d/%-6d %3d%%%s",
+                sample->name,
+                sample->priority,
+                (uint32_t)((sample->cycles * 100) / MAX(firstSnapshot.totalCycles, 1)),
+                sample->stackUsed,
+                sample->stackSize,
+                stackPercent,
+                (stackPercent >= PROFILER_STACK_WARNING_PERCENT) ? " <-- stack almost full" : "");
+  }
+  if (firstSnapshot.missedThreads > 0) {
+    shell_warn(shell, "%d threads not shown", firstSnapshot.missedThreads);
+  }
+
+  return 0;
+}
+
+static int shellPerfHeapCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+#if defined(CONFIG_NEWLIB_LIBC) || defined(CONFIG_PICOLIBC)
+  // malloc() and C++ new
+  struct mallinfo info = mallinfo();
+  shell_print(shell, "libc heap:   %d bytes used, %d bytes free", info.uordblks, info.fordblks);
+#endif // CONFIG_NEWLIB_LIBC || CONFIG_PICOLIBC
+
+#if defined(CONFIG_HEAP_MEM_POOL_SIZE) && (CONFIG_HEAP_MEM_POOL_SIZE > 0)
+  // k_malloc()
+  struct sys_memory_stats stats = {0};
+  if (sys_heap_runtime_stats_get(&_system_heap.heap, &stats) == 0) {
+    shell_print(shell, "System heap: %d bytes used (%d max), %d bytes free",
+                stats.allocated_bytes,
+                stats.max_allocated_bytes,
+                stats.free_bytes);
+  }
+#endif // CONFIG_HEAP_MEM_POOL_SIZE
+
+  return 0;
+}
+
+static int shellPerfChannelsCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  uint32_t index = 0;
+
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  takeSnapshot(&firstSnapshot);
+
+  shell_print(shell, "%-16s %10s %8s", "Channel", "Published", "Failed");
+  for (index = 0; index < ARRAY_SIZE(eventChannels); index++) {
+    shell_print(shell, "%-16s %10d %8d",
+                zbus_chan_name(eventChannels[index]),
+                firstSnapshot.channels[index].published,
+                firstSnapshot.channels[index].failed);
+  }
+
+  return 0;
+}
+
+static int shellPerfSampleCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  uint32_t index = 0;
+  uint32_t periodS = PROFILER_DEFAULT_SAMPLE_PERIOD_S;
+  uint64_t totalCycles = 0;
+  uint64_t cycles = 0;
+  const thread_sample_t *sample = NULL;
+  const thread_sample_t *previous = NULL;
+
+  if (argc > 1) {
+    periodS = (uint32_t)strtoul(argv[1], NULL, 10);
+    if (periodS == 0) {
+      shell_error(shell, "Invalid period: %s", argv[1]);
+      return -EINVAL;
+    }
+  }
+
+  shell_print(shell, "Sampling for %d s...", periodS);
+  takeSnapshot(&firstSnapshot);
+  k_sleep(K_SECONDS(periodS));
+  takeSnapshot(&secondSnapshot);
+
+  totalCycles = MAX(secondSnapshot.totalCycles - firstSnapshot.totalCycles, 1);
+  shell_print(shell, "%-24s %6s", "Thread", "CPU");
+  for (index = 0; index < secondSnapshot.threadCount; index++) {
+    sample = &secondSnapshot.threads[index];
+    // Threads created during the period are counted from their start
+    previous = findThread(&firstSnapshot, sample->thread);
+    cycles = sample->cycles - (previous ? previous->cycles : 0);
+    if (cycles == 0) {
+      continue;
+    }
+    shell_print(shell, "%-24s %3d.%d%%",
+                sample->name,
+                (uint32_t)((cycles * 100) / totalCycles),
+                (uint32_t)(((cycles * 1000) / totalCycles) % 10));
+  }
+
+  shell_print(shell, "%-16s %10s %8s", "Channel", "Published", "Failed");
+  for (index = 0; index < ARRAY_SIZE(eventChannels); index++) {
+    shell_print(shell, "%-16s %10d %8d",
+                zbus_chan_name(eventChannels[index]),
+                secondSnapshot.channels[index].published - firstSnapshot.channels[index].published,
+                secondSnapshot.channels[index].failed - firstSnapshot.channels[index].failed);
+  }
+
+  return 0;
+}
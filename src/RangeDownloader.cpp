@@ -0,0 +1,326 @@
+// Lib C
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(RangeDownloader);
+
+// User C++ class headers
+#include "RangeDownloader.h"
+
+// Each connection polls its own socket, keep the number of streams within what poll() supports
+BUILD_ASSERT(CONFIG_UPDATER_DOWNLOAD_STREAMS <= CONFIG_NET_SOCKETS_POLL_MAX,
+             "CONFIG_UPDATER_DOWNLOAD_STREAMS exceeds CONFIG_NET_SOCKETS_POLL_MAX");
+
+static constexpr uint32_t RANGE_DOWNLOADER_MAX_STREAMS = CONFIG_UPDATER_DOWNLOAD_STREAMS;
+static constexpr uint32_t RANGE_DOWNLOADER_CHUNK_SIZE = CONFIG_UPDATER_DOWNLOAD_CHUNK_SIZE;
+// Two slots per stream so that a stream can fetch its next range while the previous one waits
+static constexpr uint32_t RANGE_DOWNLOADER_SLOT_COUNT = 2 * RANGE_DOWNLOADER_MAX_STREAMS;
+static constexpr uint32_t RANGE_DOWNLOADER_STACK_SIZE = 4096;
+static constexpr uint32_t RANGE_DOWNLOADER_THREAD_PRIORITY = 7;
+static constexpr uint32_t RANGE_DOWNLOADER_FETCH_ATTEMPTS = 3;
+
+typedef enum {
+  SLOT_FREE = 0,
+  SLOT_FETCHING,
+  SLOT_READY
+} slot_state_t;
+
+typedef struct {
+  slot_state_t state;
+  uint32_t chunk;
+  uint32_t length;
+} slot_t;
+
+static void streamThreadHandler(void *p1, void *p2, void *p3);
+
+// Worker threads and reorder buffer, shared by all instances so only one download runs at a time
+K_MUTEX_DEFINE(rangeDownloaderMutex);
+K_THREAD_STACK_ARRAY_DEFINE(streamStacks, RANGE_DOWNLOADER_MAX_STREAMS, RANGE_DOWNLOADER_STACK_SIZE);
+static struct k_thread streamThreads[RANGE_DOWNLOADER_MAX_STREAMS];
+static slot_t slots[RANGE_DOWNLOADER_SLOT_COUNT];
+static uint8_t slotBuffers[RANGE_DOWNLOADER_SLOT_COUNT][RANGE_DOWNLOADER_CHUNK_SIZE];
+
+RangeDownloader::RangeDownloader(char *server, uint16_t port) {
+  assert(server);
+  assert(port);
+
+  this->server = server;
+  this->port = port;
+  this->endpoint = NULL;
+  this->offset = 0;
+  this->totalSize = 0;
+  this->etag[0] = '\0';
+  this->chunkCount = 0;
+  this->nextChunk = 0;
+  this->writtenChunk = 0;
+  this->error = 0;
+  k_mutex_init(&this->mutex);
+  k_condvar_init(&this->condition);
+}
+
+RangeDownloader::~RangeDownloader() {
+  // Destructor is automatically called when the object goes out of scope or is explicitly deleted
+}
+
+int RangeDownloader::download(const char *endpoint,
+                              uint32_t offset,
+                              uint8_t streams,
+                              InplaceFunction<int(HttpResponse *)> callback,
+                              const char *etag) {
+  int ret = 0;
+  uint32_t chunk = 0;
+  uint32_t index = 0;
+  uint32_t threadCount = 0;
+  slot_t *slot = NULL;
+  HttpResponse response = {0};
+
+  assert(endpoint);
+  assert(callback);
+
+  k_mutex_lock(&rangeDownloaderMutex, K_FOREVER);
+
+  this->endpoint = endpoint;
+  this->offset = offset;
+  this->totalSize = 0;
+  this->etag[0] = '\0';
+  if (etag) {
+    strncpy(this->etag, etag, sizeof(this->etag) - 1);
+    this->etag[sizeof(this->etag) - 1] = '\0';
+  }
+  this->error = 0;
+  memset((void *)slots, 0x00, sizeof(slots));
+
+  // 0. Fetch the first range from this thread to learn the total size of the file
+  {
+    HttpClient client(this->server, this->port);
+
+    ret = this->fetchChunk(&client, 0, slotBuffers[0], &slots[0].length);
+    if (ret < 0) {
+      k_mutex_unlock(&rangeDownloaderMutex);
+      return ret;
+    }
+  }
+  slots[0].state = SLOT_READY;
+  slots[0].chunk = 0;
+  this->chunkCount = DIV_ROUND_UP(this->totalSize - offset, RANGE_DOWNLOADER_CHUNK_SIZE);
+  this->nextChunk = 1;
+  this->writtenChunk = 0;
+
+  // 1. Start the workers fetching the remaining ranges
+  threadCount = CLAMP(streams, 1, RANGE_DOWNLOADER_MAX_STREAMS);
+  threadCount = MIN(threadCount, this->chunkCount - 1);
+  for (index = 0; index < threadCount; index++) {
+    k_thread_create(&streamThreads[index],
+                    streamStacks[index],
+                    K_THREAD_STACK_SIZEOF(streamStacks[index]),
+                    streamThreadHandler,
+                    this,
+                    NULL,
+                    NULL,
+                    RANGE_DOWNLOADER_THREAD_PRIORITY,
+                    0,
+                    K_NO_WAIT);
+    k_thread_name_set(&streamThreads[index], "rangeStream");
+  }
+  LOG_DBG("Downloading %d ranges over %d streams", this->chunkCount, threadCount);
+
+  // 2. Hand the ranges over to the callback strictly in order
+  for (chunk = 0; chunk < this->chunkCount; chunk++) {
+    slot = &slots[chunk % RANGE_DOWNLOADER_SLOT_COUNT];
+
+    k_mutex_lock(&this->mutex, K_FOREVER);
+    while ((this->error == 0) && !((slot->state == SLOT_READY) && (slot->chunk == chunk))) {
+      k_condvar_wait(&this->condition, &this->mutex, K_FOREVER);
+    }
+    ret = this->error;
+    k_mutex_unlock(&this->mutex);
+    if (ret < 0) {
+      break;
+    }
+
+    response.body = slotBuffers[chunk % RANGE_DOWNLOADER_SLOT_COUNT];
+    response.bodyLength = slot->length;
+    response.totalSize = this->totalSize - offset;
+    response.isComplete = (chunk == (this->chunkCount - 1));
+    response.statusCode = 206;
+    response.rangeStart = offset;
+    response.rangeTotal = this->totalSize;
+    response.etag = (this->etag[0] != '\0') ? this->etag : NULL;
+    ret = callback(&response);
+
+    // Free the slot for the range that is SLOT_COUNT ranges ahead
+    k_mutex_lock(&this->mutex, K_FOREVER);
+    slot->state = SLOT_FREE;
+    this->writtenChunk++;
+    if ((ret < 0) && (this->error == 0)) {
+      this->error = ret;
+    }
+    k_condvar_broadcast(&this->condition);
+    k_mutex_unlock(&this->mutex);
+    if (ret < 0) {
+      break;
+    }
+  }
+
+  // 3. Wait for the workers, they exit as soon as there is nothing left to fetch or on error
+  for (index = 0; index < threadCount; index++) {
+    k_thread_join(&streamThreads[index], K_FOREVER);
+  }
+
+  k_mutex_unlock(&rangeDownloaderMutex);
+
+  return ret;
+}
+
+void RangeDownloader::runStream() {
+  int ret = 0;
+  int chunk = 0;
+  uint32_t attempt = 0;
+  uint32_t length = 0;
+  HttpClient client(this->server, this->port, true);
+
+  while ((chunk = this->claimChunk()) >= 0) {
+    for (attempt = 0; attempt < RANGE_DOWNLOADER_FETCH_ATTEMPTS; attempt++) {
+      ret = this->fetchChunk(&client,
+                             chunk,
+                             slotBuffers[chunk % RANGE_DOWNLOADER_SLOT_COUNT],
+                             &length);
+      // Asking again won't make the server support range requests
+      if ((ret == 0) || (ret == -ENOTSUP)) {
+        break;
+      }
+      LOG_WRN("Failed to fetch range %d (%d), retrying", chunk, ret);
+    }
+    this->releaseChunk(chunk, length, ret);
+  }
+}
+
+int RangeDownloader::fetchChunk(HttpClient *client, uint32_t chunk, uint8_t *buffer, uint32_t *length) {
+  int ret = 0;
+  bool rangeIsValid = false;
+  uint32_t first = 0;
+  uint32_t last = 0;
+  char rangeHeader[48] = {0};
+  char ifRangeHeader[HTTP_CLIENT_ETAG_MAX_LENGTH + 16] = {0};
+  const char *headers[] = {rangeHeader, NULL, NULL};
+  HttpRequestOptions options = {.headers = headers, .timeoutMs = CONFIG_UPDATER_DOWNLOAD_TIMEOUT_MS};
+
+  assert(client);
+  assert(buffer);
+  assert(length);
+
+  first = this->offset + (chunk * RANGE_DOWNLOADER_CHUNK_SIZE);
+  last = first + RANGE_DOWNLOADER_CHUNK_SIZE - 1;
+  if ((this->totalSize > 0) && (last >= this->totalSize)) {
+    last = this->totalSize - 1;
+  }
+  snprintk(rangeHeader, sizeof(rangeHeader), "Range: bytes=%u-%u\r\n", first, last);
+  // Set before the workers start, a changed file is answered with a 200 and rejected below
+  if (this->etag[0] != '\0') {
+    snprintk(ifRangeHeader, sizeof(ifRangeHeader), "If-Range: %s\r\n", this->etag);
+    headers[1] = ifRangeHeader;
+  }
+
+  *length = 0;
+  ret = client->get(this->endpoint, [&](HttpResponse *response) {
+    uint32_t copyLength = 0;
+
+    // Only a 206 reply for exactly the requested range can be stored in the slot. Any other reply
+    // is likely the whole image, it is aborted instead of being received for nothing
+    if (*length == 0) {
+      rangeIsValid = (response->statusCode == 206) && (response->rangeStart == first);
+      if (rangeIsValid && (this->totalSize == 0)) {
+        this->totalSize = response->rangeTotal;
+        // The other ranges must come from the same version of the file as this first one
+        if ((this->etag[0] == '\0') && response->etag) {
+          strncpy(this->etag, response->etag, sizeof(this->etag) - 1);
+        }
+      }
+    }
+    if (!rangeIsValid) {
+      client->abort();
+      return;
+    }
+    if (response->bodyLength == 0) {
+      return;
+    }
+
+    copyLength = MIN(response->bodyLength, RANGE_DOWNLOADER_CHUNK_SIZE - *length);
+    memcpy(&buffer[*length], response->body, copyLength);
+    *length += copyLength;
+  }, &options);
+
+  if ((ret < 0) && (ret != -ECONNABORTED)) {
+    return ret;
+  }
+  if (!rangeIsValid || (this->totalSize == 0)) {
+    LOG_ERR("Server doesn't support range requests");
+    return -ENOTSUP;
+  }
+  // The first range is requested before the size is known, the last one may be shorter
+  if ((this->totalSize > first) && (last >= this->totalSize)) {
+    last = this->totalSize - 1;
+  }
+  if (*length != (last - first + 1)) {
+    return -EIO;
+  }
+
+  return 0;
+}
+
+int RangeDownloader::claimChunk() {
+  int chunk = -1;
+
+  k_mutex_lock(&this->mutex, K_FOREVER);
+
+  // Wait until the slot of the next range has been written to flash and is free again
+  while ((this->error == 0) &&
+         (this->nextChunk < this->chunkCount) &&
+         (this->nextChunk >= (this->writtenChunk + RANGE_DOWNLOADER_SLOT_COUNT))) {
+    k_condvar_wait(&this->condition, &this->mutex, K_FOREVER);
+  }
+
+  if ((this->error == 0) && (this->nextChunk < this->chunkCount)) {
+    chunk = this->nextChunk++;
+    slots[chunk % RANGE_DOWNLOADER_SLOT_COUNT].state = SLOT_FETCHING;
+    slots[chunk % RANGE_DOWNLOADER_SLOT_COUNT].chunk = chunk;
+    slots[chunk % RANGE_DOWNLOADER_SLOT_COUNT].length = 0;
+  }
+
+  k_mutex_unlock(&this->mutex);
+
+  return chunk;
+}
+
+void RangeDownloader::releaseChunk(uint32_t chunk, uint32_t length, int ret) {
+  k_mutex_lock(&this->mutex, K_FOREVER);
+
+  if (ret < 0) {
+    if (this->error == 0) {
+      this->error = ret;
+    }
+  } else {
+    slots[chunk % RANGE_DOWNLOADER_SLOT_COUNT].length = length;
+    slots[chunk % RANGE_DOWNLOADER_SLOT_COUNT].state = SLOT_READY;
+  }
+
+  k_condvar_broadcast(&this->condition);
+  k_mutex_unlock(&this->mutex);
+}
+
+static void streamThreadHandler(void *p1, void *p2, void *p3) {
+  RangeDownloader *downloader = static_cast<RangeDownloader *>(p1);
+
+  ARG_UNUSED(p2);
+  ARG_UNUSED(p3);
+
+  assert(downloader);
+
+  downloader->runStream();
+}
@@ -0,0 +1,306 @@
+// Lib C
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(SlotEraser);
+
+// User C++ class headers
+#include "SlotEraser.h"
+
+static void slotEraserThreadHandler();
+
+// Held for the whole erase of a sector, prepare() waits for at most one background erase
+K_MUTEX_DEFINE(slotEraserMutex);
+K_SEM_DEFINE(slotEraserWakeup, 0, 1);
+
+// Below every other application thread, sectors are only erased while they are all idle
+K_THREAD_DEFINE(slotEraserThread, CONFIG_SLOT_ERASER_STACK_SIZE, slotEraserThreadHandler, NULL, NULL, NULL,
+                K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
+
+static void slotEraserThreadHandler() {
+  slot_eraser_stats_t stats = {0};
+
+  while (true) {
+    k_sem_take(&slotEraserWakeup, K_FOREVER);
+    while (SlotEraser::getInstance().cleanNextSector()) {
+    }
+    SlotEraser::getInstance().getStats(&stats);
+    LOG_INF("%d/%d sectors clean, %d erased in %d ms, %d found blank",
+            stats.cleanSectors,
+            stats.sectorCount,
+            stats.backgroundErases,
+            stats.backgroundEraseTimeMs,
+            stats.blankSectors);
+  }
+}
+
+// Define the static member
+SlotEraser SlotEraser::instance;
+
+SlotEraser& SlotEraser::getInstance() {
+  // Return the singleton instance
+  return instance;
+}
+
+SlotEraser::SlotEraser() {
+  this->area = NULL;
+  memset(this->sectors, 0x00, sizeof(this->sectors));
+  memset(this->states, 0x00, sizeof(this->states));
+  memset(this->buffer, 0x00, sizeof(this->buffer));
+  memset(&this->stats, 0x00, sizeof(this->stats));
+}
+
+SlotEraser::~SlotEraser() {
+  if (this->area) {
+    flash_area_close(this->area);
+  }
+}
+
+int SlotEraser::start(uint8_t partitionId, size_t keepSize) {
+  int ret = 0;
+  uint32_t count = SLOT_ERASER_MAX_SECTORS;
+  uint32_t sector = 0;
+
+  k_mutex_lock(&slotEraserMutex, K_FOREVER);
+
+  if (!this->area) {
+    ret = flash_area_open(partitionId, &this->area);
+    if (ret < 0) {
+      LOG_ERR("Failed to open partition %d (%d)", partitionId, ret);
+      this->area = NULL;
+      k_mutex_unlock(&slotEraserMutex);
+      return ret;
+    }
+  }
+
+  ret = flash_area_get_sectors(partitionId, &count, this->sectors);
+  if (ret < 0) {
+    LOG_ERR("Failed to get the sectors of partition %d (%d)", partitionId, ret);
+    flash_area_close(this->area);
+    this->area = NULL;
+    k_mutex_unlock(&slotEraserMutex);
+    return ret;
+  }
+
+  // Sectors holding data to keep are treated as being written, the others are checked one by one
+  memset(&this->stats, 0x00, sizeof(this->stats));
+  this->stats.sectorCount = count;
+  for (sector = 0; sector < count; sector++) {
+    this->states[sector] = (this->sectors[sector].fs_off < keepSize) ? SectorState::WRITING : SectorState::DIRTY;
+  }
+
+  k_mutex_unlock(&slotEraserMutex);
+  k_sem_give(&slotEraserWakeup);
+
+  return 0;
+}
+
+size_t SlotEraser::resumableOffset(size_t offset) {
+  uint32_t sector = 0;
+  size_t sectorEnd = 0;
+  size_t resumable = offset;
+
+  k_mutex_lock(&slotEraserMutex, K_FOREVER);
+
+  // The saved progress lags behind what was actually written, the rest of its sector may hold data
+  // that can't be written over. Resuming from the start of the sector erases it again
+  for (sector = 0; (sector < this->stats.sectorCount) && this->area; sector++) {
+    sectorEnd = this->sectors[sector].fs_off + this->sectors[sector].fs_size;
+    if ((offset > this->sectors[sector].fs_off) && (offset < sectorEnd)) {
+      if (!this->isBlank(offset, sectorEnd - offset)) {
+        resumable = this->sectors[sector].fs_off;
+        LOG_WRN("Data was written past offset %d, resuming at %d", offset, resumable);
+      }
+      break;
+    }
+  }
+
+  k_mutex_unlock(&slotEraserMutex);
+
+  return resumable;
+}
+
+void SlotEraser::seek(size_t offset) {
+  uint32_t sector = 0;
+  bool dirtied = false;
+
+  k_mutex_lock(&slotEraserMutex, K_FOREVER);
+
+  // Whatever was written from there on belongs to the previous attempt
+  for (sector = 0; sector < this->stats.sectorCount; sector++) {
+    if ((this->sectors[sector].fs_off >= offset) && (this->states[sector] == SectorState::WRITING)) {
+      this->states[sector] = SectorState::DIRTY;
+      dirtied = true;
+    }
+  }
+
+  k_mutex_unlock(&slotEraserMutex);
+
+  if (dirtied) {
+    k_sem_give(&slotEraserWakeup);
+  }
+}
+
+int SlotEraser::prepare(size_t offset, size_t length) {
+  int ret = 0;
+  uint32_t sector = 0;
+  size_t end = offset + length;
+
+  if (length == 0) {
+    return 0;
+  }
+
+  k_mutex_lock(&slotEraserMutex, K_FOREVER);
+
+  if (!this->area) {
+    k_mutex_unlock(&slotEraserMutex);
+    return -ENODEV;
+  }
+
+  for (sector = 0; sector < this->stats.sectorCount; sector++) {
+    if (this->sectors[sector].fs_off >= end) {
+      break;
+    }
+    if ((this->sectors[sector].fs_off + this->sectors[sector].fs_size) <= offset) {
+      continue;
+    }
+    // Only sectors the background thread hasn't reached yet cost an erase here
+    if (this->states[sector] == SectorState::DIRTY) {
+      ret = this->cleanSector(sector, true);
+      if (ret < 0) {
+        break;
+      }
+    }
+    this->states[sector] = SectorState::WRITING;
+  }
+
+  k_mutex_unlock(&slotEraserMutex);
+
+  return ret;
+}
+
+int SlotEraser::finish() {
+  int ret = 0;
+  uint32_t sector = 0;
+
+  k_mutex_lock(&slotEraserMutex, K_FOREVER);
+
+  if (!this->area) {
+    k_mutex_unlock(&slotEraserMutex);
+    return -ENODEV;
+  }
+
+  for (sector = 0; sector < this->stats.sectorCount; sector++) {
+    if (this->states[sector] == SectorState::DIRTY) {
+      ret = this->cleanSector(sector, true);
+      if (ret < 0) {
+        break;
+      }
+    }
+  }
+
+  k_mutex_unlock(&slotEraserMutex);
+
+  return ret;
+}
+
+void SlotEraser::getStats(slot_eraser_stats_t *stats) {
+  uint32_t sector = 0;
+
+  assert(stats);
+
+  k_mutex_lock(&slotEraserMutex, K_FOREVER);
+  *stats = this->stats;
+  stats->cleanSectors = 0;
+  for (sector = 0; sector < this->stats.sectorCount; sector++) {
+    if (this->states[sector] == SectorState::CLEAN) {
+      stats->cleanSectors++;
+    }
+  }
+  k_mutex_unlock(&slotEraserMutex);
+}
+
+bool SlotEraser::cleanNextSector() {
+  int ret = 0;
+  uint32_t sector = 0;
+
+  k_mutex_lock(&slotEraserMutex, K_FOREVER);
+
+  // One sector per call so that the mutex is released between erases
+  for (sector = 0; sector < this->stats.sectorCount; sector++) {
+    if (this->states[sector] == SectorState::DIRTY) {
+      break;
+    }
+  }
+  if ((sector == this->stats.sectorCount) || !this->area) {
+    k_mutex_unlock(&slotEraserMutex);
+    return false;
+  }
+
+  // On failure the sector stays dirty and is erased on demand when it is written
+  ret = this->cleanSector(sector, false);
+
+  k_mutex_unlock(&slotEraserMutex);
+
+  return (ret == 0);
+}
+
+int SlotEraser::cleanSector(uint32_t sector, bool onDemand) {
+  int ret = 0;
+  int64_t startTime = 0;
+  uint32_t elapsedTime = 0;
+
+  // Reading is much cheaper than erasing, and doesn't wear the flash out
+  if (this->isBlank(this->sectors[sector].fs_off, this->sectors[sector].fs_size)) {
+    this->stats.blankSectors++;
+    this->states[sector] = SectorState::CLEAN;
+    return 0;
+  }
+
+  startTime = k_uptime_get();
+  ret = flash_area_erase(this->area, this->sectors[sector].fs_off, this->sectors[sector].fs_size);
+  if (ret < 0) {
+    LOG_ERR("Failed to erase sector %d (%d)", sector, ret);
+    return ret;
+  }
+  elapsedTime = (uint32_t)(k_uptime_get() - startTime);
+
+  if (onDemand) {
+    this->stats.onDemandErases++;
+    this->stats.onDemandEraseTimeMs += elapsedTime;
+  } else {
+    this->stats.backgroundErases++;
+    this->stats.backgroundEraseTimeMs += elapsedTime;
+  }
+  this->states[sector] = SectorState::CLEAN;
+
+  return 0;
+}
+
+bool SlotEraser::isBlank(off_t offset, size_t length) {
+  size_t chunk = 0;
+  size_t index = 0;
+  uint8_t erasedValue = flash_area_erased_val(this->area);
+
+  while (length > 0) {
+    chunk = MIN(length, sizeof(this->buffer));
+    if (flash_area_read(this->area, offset, this->buffer, chunk) < 0) {
+      return false;
+    }
+    for (index = 0; index < chunk; index++) {
+      if (this->buffer[index] != erasedValue) {
+        return false;
+      }
+    }
+    offset += chunk;
+    length -= chunk;
+  }
+
+  return true;
+}
@@ -0,0 +1,119 @@
+// Lib C
+#include <errno.h>
+#include <assert.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(Storage);
+
+// User C++ class headers
+#include "Storage.h"
+
+// Serializes the lazy mount, NVS itself already serializes reads and writes
+K_MUTEX_DEFINE(storageMutex);
+
+// Define the static member
+Storage Storage::instance;
+
+Storage& Storage::getInstance() {
+  // Return the singleton instance
+  return instance;
+}
+
+Storage::Storage() {
+  this->isMounted = false;
+}
+
+Storage::~Storage() {
+}
+
+ssize_t Storage::read(storage_id_t id, void *data, size_t length) {
+  int ret = 0;
+
+  assert(data);
+  assert(length);
+
+  ret = this->mount();
+  if (ret < 0) {
+    return ret;
+  }
+
+  return nvs_read(&this->fs, (uint16_t)id, data, length);
+}
+
+ssize_t Storage::write(storage_id_t id, const void *data, size_t length) {
+  int ret = 0;
+
+  assert(data);
+  assert(length);
+
+  ret = this->mount();
+  if (ret < 0) {
+    return ret;
+  }
+
+  // nvs_write() returns 0 when the stored data is identical, avoiding useless flash wear
+  return nvs_write(&this->fs, (uint16_t)id, data, length);
+}
+
+int Storage::remove(storage_id_t id) {
+  int ret = 0;
+
+  ret = this->mount();
+  if (ret < 0) {
+    return ret;
+  }
+
+  return nvs_delete(&this->fs, (uint16_t)id);
+}
+
+int Storage::mount() {
+  int ret = 0;
+
+#if FIXED_PARTITION_EXISTS(storage_partition)
+  struct flash_pages_info info = {0};
+
+  k_mutex_lock(&storageMutex, K_FOREVER);
+
+  if (this->isMounted) {
+    k_mutex_unlock(&storageMutex);
+    return 0;
+  }
+
+  this->fs.flash_device = FIXED_PARTITION_DEVICE(storage_partition);
+  if (!device_is_ready(this->fs.flash_device)) {
+    LOG_ERR("Flash device %s is not ready", this->fs.flash_device->name);
+    k_mutex_unlock(&storageMutex);
+    return -ENODEV;
+  }
+
+  // Use one NVS sector per flash page of the storage_partition
+  this->fs.offset = FIXED_PARTITION_OFFSET(storage_partition);
+  ret = flash_get_page_info_by_offs(this->fs.flash_device, this->fs.offset, &info);
+  if (ret) {
+    LOG_ERR("Unable to get page info (%d)", ret);
+    k_mutex_unlock(&storageMutex);
+    return ret;
+  }
+  this->fs.sector_size = info.size;
+  this->fs.sector_count = FIXED_PARTITION_SIZE(storage_partition) / info.size;
+
+  ret = nvs_mount(&this->fs);
+  if (ret) {
+    LOG_ERR("Failed to mount NVS (%d)", ret);
+  } else {
+    this->isMounted = true;
+  }
+
+  k_mutex_unlock(&storageMutex);
+#else
+  LOG_ERR("No storage_partition defined for this board");
+  ret = -ENODEV;
+#endif // FIXED_PARTITION_EXISTS(storage_partition)
+
+  return ret;
+}
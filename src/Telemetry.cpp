@@ -0,0 +1,306 @@
+// Lib C
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+// Zephyr includes
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/zbus/zbus.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(Telemetry);
+
+// User C++ class headers
+#include "EventManager.h"
+#include "Telemetry.h"
+
+// Compact record kept in RAM, also the on-wire record format
+typedef struct __packed {
+  uint8_t sensor;
+  uint16_t deltaDs;
+  int16_t value;
+} telemetry_record_t;
+
+static constexpr uint32_t TELEMETRY_HEADER_SIZE = 7;
+static constexpr uint32_t TELEMETRY_RECORD_SIZE = 5;
+static constexpr uint32_t TELEMETRY_MAX_RECORDS_PER_POST =
+  (CONFIG_TELEMETRY_MAX_PAYLOAD_SIZE - TELEMETRY_HEADER_SIZE) / TELEMETRY_RECORD_SIZE;
+static constexpr uint32_t TELEMETRY_MS_PER_TICK = 100;
+
+BUILD_ASSERT(sizeof(telemetry_record_t) == TELEMETRY_RECORD_SIZE, "Unexpected telemetry record size");
+BUILD_ASSERT(CONFIG_TELEMETRY_MAX_PAYLOAD_SIZE >= TELEMETRY_HEADER_SIZE + TELEMETRY_RECORD_SIZE,
+             "Telemetry payload can't hold a single record");
+
+static void sampleWorkHandler(struct k_work *work);
+static void telemetryListenerCallback(const struct zbus_channel *channel);
+static int shellTelemetryCommandHandler(const struct shell *shell, size_t argc, char **argv);
+
+// Follow the network availability
+ZBUS_LISTENER_DEFINE(telemetryListener, telemetryListenerCallback);
+ZBUS_CHAN_ADD_OBS(networkChannel, telemetryListener, 5);
+
+// Shell command registration
+SHELL_CMD_REGISTER(telemetry, NULL, "Show telemetry statistics", shellTelemetryCommandHandler);
+
+static const char *telemetryHeaders[] = {"Content-Type: application/octet-stream\r\n", NULL};
+
+// Ring of records, ringHead is the oldest one and baseTimestampMs its timestamp
+static telemetry_record_t ring[CONFIG_TELEMETRY_RING_SIZE];
+static uint32_t ringHead = 0;
+static uint32_t ringCount = 0;
+static uint32_t baseTimestampMs = 0;
+static uint32_t lastTimestampMs = 0;
+static uint8_t payload[CONFIG_TELEMETRY_MAX_PAYLOAD_SIZE];
+
+// Define the static member
+Telemetry Telemetry::instance;
+
+Telemetry& Telemetry::getInstance() {
+  // Return the singleton instance
+  return instance;
+}
+
+Telemetry::Telemetry() : client((char *)CONFIG_TELEMETRY_SERVER, CONFIG_TELEMETRY_PORT, true) {
+  this->sensorCount = 0;
+  this->networkIsAvailable = false;
+  this->postInFlight = false;
+  this->recordsInFlight = 0;
+  this->droppedInFlight = 0;
+  this->responseStatus = 0;
+  memset((void *)&this->stats, 0x00, sizeof(this->stats));
+  k_mutex_init(&this->mutex);
+  k_work_init_delayable(&this->sampleWork, sampleWorkHandler);
+
+  this->options.headers = telemetryHeaders;
+  this->options.buffer = NULL;
+  this->options.bufferSize = 0;
+  this->options.timeoutMs = 0;
+  this->request.fifoReserved = NULL;
+  this->request.method = HTTP_POST;
+  this->request.endpoint = CONFIG_TELEMETRY_ENDPOINT;
+  this->request.data = (const char *)payload;
+  this->request.options = &this->options;
+  this->request.callback = [](HttpResponse *response) {
+    Telemetry::getInstance().responseStatus = response->statusCode;
+  };
+  this->request.onComplete = [](HttpAsyncRequest *request) {
+    Telemetry::getInstance().onPostComplete(request);
+  };
+  this->request.signal = NULL;
+  this->request.result = 0;
+  this->request.client = NULL;
+}
+
+Telemetry::~Telemetry() {
+}
+
+int Telemetry::addSensor(telemetry_sensor_t sensor, InplaceFunction<int(int16_t *value)> read) {
+  assert(read);
+
+  k_mutex_lock(&this->mutex, K_FOREVER);
+  if (this->sensorCount >= TELEMETRY_MAX_SENSORS) {
+    k_mutex_unlock(&this->mutex);
+    return -ENOMEM;
+  }
+  this->sensors[this->sensorCount].id = sensor;
+  this->sensors[this->sensorCount].read = read;
+  this->sensorCount++;
+  k_mutex_unlock(&this->mutex);
+
+  return 0;
+}
+
+void Telemetry::start() {
+  k_work_reschedule(&this->sampleWork, K_NO_WAIT);
+}
+
+void Telemetry::setNetworkAvailable(bool available) {
+  this->networkIsAvailable = available;
+}
+
+void Telemetry::getStats(telemetry_stats_t *stats) {
+  assert(stats);
+
+  k_mutex_lock(&this->mutex, K_FOREVER);
+  memcpy(stats, &this->stats, sizeof(*stats));
+  k_mutex_unlock(&this->mutex);
+}
+
+void Telemetry::sample() {
+  int ret = 0;
+  uint8_t index = 0;
+  int16_t value = 0;
+  uint32_t nowMs = k_uptime_get_32();
+
+  k_mutex_lock(&this->mutex, K_FOREVER);
+
+  for (index = 0; index < this->sensorCount; index++) {
+    ret = this->sensors[index].read(&value);
+    if (ret < 0) {
+      LOG_WRN("Failed to read sensor %d (%d)", this->sensors[index].id, ret);
+      continue;
+    }
+    this->push(this->sensors[index].id, value, nowMs);
+  }
+
+  if (this->networkIsAvailable && !this->postInFlight && this->shouldFlush(nowMs)) {
+    this->flush();
+  }
+
+  k_mutex_unlock(&this->mutex);
+
+  k_work_reschedule(&this->sampleWork, K_MSEC(CONFIG_TELEMETRY_SAMPLE_PERIOD_MS));
+}
+
+void Telemetry::onPostComplete(HttpAsyncRequest *request) {
+  uint32_t sentRecords = 0;
+
+  assert(request);
+
+  k_mutex_lock(&this->mutex, K_FOREVER);
+
+  if ((request->result >= 0) && (this->responseStatus >= 200) && (this->responseStatus < 300)) {
+    // Records dropped by the ring while the request was in flight were part of the batch
+    sentRecords = this->recordsInFlight;
+    this->pop((sentRecords > this->droppedInFlight) ? (sentRecords - this->droppedInFlight) : 0);
+    this->stats.posts++;
+    this->stats.samplesSent += sentRecords;
+    this->stats.bytesSent += request->length;
+  } else {
+    LOG_WRN("Telemetry upload failed (%d, status %d)", request->result, this->responseStatus);
+    this->stats.failedPosts++;
+  }
+  this->postInFlight = false;
+
+  k_mutex_unlock(&this->mutex);
+}
+
+void Telemetry::push(telemetry_sensor_t sensor, int16_t value, uint32_t timestampMs) {
+  uint32_t ticks = 0;
+  telemetry_record_t *record = NULL;
+
+  // Drop the oldest record when the ring is full
+  if (ringCount == CONFIG_TELEMETRY_RING_SIZE) {
+    this->pop(1);
+    this->stats.dropped++;
+    if (this->postInFlight) {
+      this->droppedInFlight++;
+    }
+  }
+
+  // Timestamps are stored as a delta to the previous record, accumulated so they don't drift
+  if (ringCount == 0) {
+    baseTimestampMs = timestampMs;
+    lastTimestampMs = timestampMs;
+  } else {
+    ticks = MIN((timestampMs - lastTimestampMs) / TELEMETRY_MS_PER_TICK, UINT16_MAX);
+    lastTimestampMs += ticks * TELEMETRY_MS_PER_TICK;
+  }
+
+  record = &ring[(ringHead + ringCount) % CONFIG_TELEMETRY_RING_SIZE];
+  record->sensor = (uint8_t)sensor;
+  record->deltaDs = (uint16_t)ticks;
+  record->value = value;
+  ringCount++;
+  this->stats.samples++;
+}
+
+void Telemetry::pop(uint32_t count) {
+  count = MIN(count, ringCount);
+
+  while (count--) {
+    ringHead = (ringHead + 1) % CONFIG_TELEMETRY_RING_SIZE;
+    ringCount--;
+    if (ringCount > 0) {
+      baseTimestampMs += ring[ringHead].deltaDs * TELEMETRY_MS_PER_TICK;
+    }
+  }
+}
+
+bool Telemetry::shouldFlush(uint32_t nowMs) {
+  if (ringCount == 0) {
+    return false;
+  }
+
+  return (ringCount >= CONFIG_TELEMETRY_BATCH_SIZE) ||
+         (ringCount >= TELEMETRY_MAX_RECORDS_PER_POST) ||
+         ((nowMs - baseTimestampMs) >= (CONFIG_TELEMETRY_MAX_AGE_S * MSEC_PER_SEC));
+}
+
+void Telemetry::flush() {
+  int ret = 0;
+  uint32_t index = 0;
+  uint32_t count = 0;
+  uint8_t *cursor = payload;
+  const telemetry_record_t *record = NULL;
+
+  count = MIN(ringCount, TELEMETRY_MAX_RECORDS_PER_POST);
+
+  // Header
+  *cursor++ = TELEMETRY_FORMAT_VERSION;
+  sys_put_le16((uint16_t)count, cursor);
+  cursor += sizeof(uint16_t);
+  sys_put_le32(baseTimestampMs, cursor);
+  cursor += sizeof(uint32_t);
+
+  // Records, the first delta is relative to the header timestamp
+  for (index = 0; index < count; index++) {
+    record = &ring[(ringHead + index) % CONFIG_TELEMETRY_RING_SIZE];
+    *cursor++ = record->sensor;
+    sys_put_le16((index == 0) ? 0 : record->deltaDs, cursor);
+    cursor += sizeof(uint16_t);
+    sys_put_le16((uint16_t)record->value, cursor);
+    cursor += sizeof(uint16_t);
+  }
+
+  // Records stay in the ring until the server acknowledges them
+  this->recordsInFlight = (uint16_t)count;
+  this->droppedInFlight = 0;
+  this->responseStatus = 0;
+  this->request.length = (uint32_t)(cursor - payload);
+  this->postInFlight = true;
+  ret = this->client.submit(&this->request);
+  if (ret < 0) {
+    LOG_ERR("Failed to submit telemetry upload (%d)", ret);
+    this->postInFlight = false;
+  }
+}
+
+static void sampleWorkHandler(struct k_work *work) {
+  ARG_UNUSED(work);
+
+  Telemetry::getInstance().sample();
+}
+
+static void telemetryListenerCallback(const struct zbus_channel *channel) {
+  const network_event_t *event = readEvent<network_event_t>(channel);
+
+  if ((event != NULL) && (event->id == EVENT_NETWORK_AVAILABLE)) {
+    Telemetry::getInstance().setNetworkAvailable(true);
+  } else if ((event != NULL) && (event->id == EVENT_NETWORK_UNAVAILABLE)) {
+    Telemetry::getInstance().setNetworkAvailable(false);
+  }
+}
+
+static int shellTelemetryCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  telemetry_stats_t stats = {0};
+  uint32_t uptimeS = 0;
+
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  Telemetry::getInstance().getStats(&stats);
+  uptimeS = MAX(k_uptime_get_32() / MSEC_PER_SEC, 1);
+
+  shell_print(shell, "Samples:          %d (%d dropped)", stats.samples, stats.dropped);
+  shell_print(shell, "POSTs:            %d (%d failed)", stats.posts, stats.failedPosts);
+  shell_print(shell, "Bytes sent:       %d", stats.bytesSent);
+  shell_print(shell, "Bytes per sample: %d.%02d",
+              stats.samplesSent ? (stats.bytesSent / stats.samplesSent) : 0,
+              stats.samplesSent ? ((stats.bytesSent * 100 / stats.samplesSent) % 100) : 0);
+  shell_print(shell, "POSTs per hour:   %d", (stats.posts * 3600) / uptimeS);
+
+  return 0;
+}
@@ -1,19 +1,70 @@
 // Lib C
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <assert.h>
 
 // Zephyr includes
+#include <zephyr/kernel.h>
 #include <zephyr/device.h>
 #include <zephyr/drivers/sensor.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/barrier.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/shell/shell.h>
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(Temperature);
 
 // User C++ class headers
 #include "Temperature.h"
 
+static void sampleWorkHandler(struct k_work *work);
+static void printMilliCelsius(const struct shell *shell, const char *label, int32_t milliCelsius);
+static int shellTemperatureCommandHandler(const struct shell *shell, size_t argc, char **argv);
+#ifdef CONFIG_TEMPERATURE_BENCHMARK
+static int shellTemperatureBenchCommandHandler(const struct shell *shell, size_t argc, char **argv);
+#endif // CONFIG_TEMPERATURE_BENCHMARK
+
+// Shell command registration
+#ifdef CONFIG_TEMPERATURE_BENCHMARK
+SHELL_STATIC_SUBCMD_SET_CREATE(
+  temperatureSubcommands,
+  SHELL_CMD(bench, NULL, "Measure the cycles per sample of the double and fixed-point conversions", shellTemperatureBenchCommandHandler),
+  SHELL_SUBCMD_SET_END
+);
+SHELL_CMD_REGISTER(temperature, &temperatureSubcommands, "Show the latest temperature reading", shellTemperatureCommandHandler);
+#else
+SHELL_CMD_REGISTER(temperature, NULL, "Show the latest temperature reading", shellTemperatureCommandHandler);
+#endif // CONFIG_TEMPERATURE_BENCHMARK
+
+// Last sensor started, the one the shell command reports
+static Temperature *sampledTemperature = NULL;
+
+#ifdef CONFIG_TEMPERATURE_BENCHMARK
+static constexpr uint32_t TEMPERATURE_BENCHMARK_CONVERSIONS = 10000;
+static constexpr uint32_t TEMPERATURE_BENCHMARK_SAMPLES = 100;
+
+// Keeps the conversions from being optimized out
+static volatile int32_t benchmarkSink = 0;
+#endif // CONFIG_TEMPERATURE_BENCHMARK
+
 Temperature::Temperature(const struct device *device) {
   assert(device);
 
   this->device = device;
+  this->periodMs = CONFIG_TEMPERATURE_SAMPLE_PERIOD_MS;
+  this->isSampling = false;
+  this->averageSum = 0;
+  this->samples = 0;
+  this->context.temperature = this;
+  memset(this->averageWindow, 0x00, sizeof(this->averageWindow));
+  memset(this->minMaxWindow, 0x00, sizeof(this->minMaxWindow));
+  memset(this->readings, 0x00, sizeof(this->readings));
+  memset(&this->stats, 0x00, sizeof(this->stats));
+  atomic_set(&this->sequence, 0);
+  atomic_set(&this->readRetries, 0);
+  k_mutex_init(&this->mutex);
+  k_work_init_delayable(&this->context.sampleWork, sampleWorkHandler);
 
   if (!device_is_ready(this->device)) {
     LOG_ERR("Error: Device is not ready\r\n");
@@ -22,24 +73,289 @@ Temperature::Temperature(const struct device *device) {
 }
 
 Temperature::~Temperature() {
-  // Destructor is automatically called when the object goes out of scope or is explicitly deleted
+  // The pending sample must not reach a destroyed object
+  this->stop();
+  if (sampledTemperature == this) {
+    sampledTemperature = NULL;
+  }
+}
+
+int Temperature::start(uint32_t periodMs) {
+  if (!device_is_ready(this->device)) {
+    return -ENODEV;
+  }
+  if (periodMs == 0) {
+    return -EINVAL;
+  }
+
+  this->periodMs = periodMs;
+  this->isSampling = true;
+  sampledTemperature = this;
+  k_work_reschedule(&this->context.sampleWork, K_NO_WAIT);
+
+  return 0;
+}
+
+void Temperature::stop() {
+  struct k_work_sync sync;
+
+  this->isSampling = false;
+  k_work_cancel_delayable_sync(&this->context.sampleWork, &sync);
+}
+
+int Temperature::read(temperature_reading_t *reading) {
+  atomic_val_t before = 0;
+  atomic_val_t after = 0;
+
+  assert(reading);
+
+  // The sampling work only writes the buffer the sequence doesn't point to, but once a sample is
+  // published the next one is written into the buffer being copied. Any change means a retry
+  while (true) {
+    before = atomic_get(&this->sequence);
+    barrier_dmem_fence_full();
+    *reading = this->readings[before & 1];
+    barrier_dmem_fence_full();
+    after = atomic_get(&this->sequence);
+    if (after == before) {
+      break;
+    }
+    atomic_inc(&this->readRetries);
+  }
+
+  return (reading->samples == 0) ? -ENODATA : 0;
+}
+
+int Temperature::measure(int32_t *milliCelsius) {
+  int ret = 0;
+  uint32_t fetch = 0;
+  uint32_t fetched = 0;
+  int64_t sum = 0;
+  struct sensor_value value = {0};
+
+  assert(milliCelsius);
+
+  // Oversampling, the fetches that fail are left out of the average
+  for (fetch = 0; fetch < CONFIG_TEMPERATURE_OVERSAMPLING; fetch++) {
+    ret = sensor_sample_fetch(this->device);
+    if (ret == 0) {
+      ret = sensor_channel_get(this->device, SENSOR_CHAN_DIE_TEMP, &value);
+    }
+
+    k_mutex_lock(&this->mutex, K_FOREVER);
+    this->stats.fetches++;
+    if (ret < 0) {
+      this->stats.failedFetches++;
+      this->stats.lastError = ret;
+    }
+    k_mutex_unlock(&this->mutex);
+
+    if (ret == 0) {
+      sum += toMilliCelsius(&value);
+      fetched++;
+    }
+  }
+
+  if (fetched == 0) {
+    LOG_ERR("Failed to fetch sample (%d)", ret);
+    return ret;
+  }
+
+  *milliCelsius = (int32_t)(sum / fetched);
+
+  return 0;
+}
+
+void Temperature::getStats(temperature_stats_t *stats) {
+  assert(stats);
+
+  k_mutex_lock(&this->mutex, K_FOREVER);
+  *stats = this->stats;
+  k_mutex_unlock(&this->mutex);
+  stats->readRetries = (uint32_t)atomic_get(&this->readRetries);
+}
+
+const struct device *Temperature::getDevice() {
+  return this->device;
+}
+
+int32_t Temperature::toMilliCelsius(const struct sensor_value *value) {
+  assert(value);
+
+  // val2 holds millionths and has the sign of val1
+  return (value->val1 * 1000) + (value->val2 / 1000);
+}
+
+void Temperature::sample() {
+  int ret = 0;
+  int32_t milliCelsius = 0;
+  uint32_t count = 0;
+  uint32_t index = 0;
+  temperature_reading_t reading = {0};
+
+  if (!this->isSampling) {
+    return;
+  }
+  k_work_reschedule(&this->context.sampleWork, K_MSEC(this->periodMs));
+
+  ret = this->measure(&milliCelsius);
+  if (ret < 0) {
+    // The last reading stays published, its timestamp tells how old it is
+    k_mutex_lock(&this->mutex, K_FOREVER);
+    this->stats.failedSamples++;
+    k_mutex_unlock(&this->mutex);
+    return;
+  }
+
+  // Moving average, the oldest sample leaves the running sum as the new one enters it
+  index = this->samples % CONFIG_TEMPERATURE_AVERAGE_WINDOW;
+  this->averageSum += milliCelsius - this->averageWindow[index];
+  this->averageWindow[index] = milliCelsius;
+  this->minMaxWindow[this->samples % CONFIG_TEMPERATURE_MINMAX_WINDOW] = milliCelsius;
+  this->samples++;
+
+  count = MIN(this->samples, (uint32_t)CONFIG_TEMPERATURE_AVERAGE_WINDOW);
+  reading.milliCelsius = (int32_t)(this->averageSum / count);
+  reading.minMilliCelsius = milliCelsius;
+  reading.maxMilliCelsius = milliCelsius;
+  count = MIN(this->samples, (uint32_t)CONFIG_TEMPERATURE_MINMAX_WINDOW);
+  for (index = 0; index < count; index++) {
+    reading.minMilliCelsius = MIN(reading.minMilliCelsius, this->minMaxWindow[index]);
+    reading.maxMilliCelsius = MAX(reading.maxMilliCelsius, this->minMaxWindow[index]);
+  }
+  reading.timestampMs = k_uptime_get();
+  reading.samples = this->samples;
+  this->publish(&reading);
+
+  k_mutex_lock(&this->mutex, K_FOREVER);
+  this->stats.samples++;
+  k_mutex_unlock(&this->mutex);
+}
+
+void Temperature::publish(const temperature_reading_t *reading) {
+  atomic_val_t next = atomic_get(&this->sequence) + 1;
+
+  // Only the sampling work publishes, the buffer readers may be copying is left alone
+  this->readings[next & 1] = *reading;
+  barrier_dmem_fence_full();
+  atomic_set(&this->sequence, next);
+}
+
+static void sampleWorkHandler(struct k_work *work) {
+  struct k_work_delayable *delayable = k_work_delayable_from_work(work);
+  temperature_context_t *context = CONTAINER_OF(delayable, temperature_context_t, sampleWork);
+
+  context->temperature->sample();
+}
+
+static void printMilliCelsius(const struct shell *shell, const char *label, int32_t milliCelsius) {
+  shell_print(shell, "%-10s %s%d.%03d °C",
+              label,
+              (milliCelsius < 0) ? "-" : "",
+              abs(milliCelsius) / 1000,
+              abs(milliCelsius) % 1000);
 }
 
-double Temperature::read() {
+static int shellTemperatureCommandHandler(const struct shell *shell, size_t argc, char **argv) {
   int ret = 0;
+  temperature_reading_t reading = {0};
+  temperature_stats_t stats = {0};
+
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  if (!sampledTemperature) {
+    shell_error(shell, "No temperature sensor is being sampled");
+    return -ENODEV;
+  }
+
+  ret = sampledTemperature->read(&reading);
+  sampledTemperature->getStats(&stats);
+  if (ret < 0) {
+    shell_print(shell, "No sample yet");
+  } else {
+    printMilliCelsius(shell, "Average:", reading.milliCelsius);
+    printMilliCelsius(shell, "Minimum:", reading.minMilliCelsius);
+    printMilliCelsius(shell, "Maximum:", reading.maxMilliCelsius);
+    shell_print(shell, "%-10s %lld ms ago", "Sampled:", k_uptime_get() - reading.timestampMs);
+  }
+  shell_print(shell, "Samples:   %d (%d failed)", stats.samples, stats.failedSamples);
+  shell_print(shell, "Fetches:   %d (%d failed, last error %d)", stats.fetches, stats.failedFetches, stats.lastError);
+  shell_print(shell, "Retries:   %d reads", stats.readRetries);
+
+  return 0;
+}
+
+#ifdef CONFIG_TEMPERATURE_BENCHMARK
+static int shellTemperatureBenchCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  int ret = 0;
+  uint32_t index = 0;
+  uint32_t startCycles = 0;
+  uint32_t doubleCycles = 0;
+  uint32_t fixedCycles = 0;
+  uint32_t doubleSampleCycles = 0;
+  uint32_t fixedSampleCycles = 0;
+  int32_t milliCelsius = 0;
   struct sensor_value value = {0};
+  const struct device *device = NULL;
+
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
 
-  ret = sensor_sample_fetch(this->device);
-  if (ret) {
-    LOG_ERR("Failed to fetch sample (%d)\n", ret);
-    return 0;
+  if (!sampledTemperature) {
+    shell_error(shell, "No temperature sensor is being sampled");
+    return -ENODEV;
   }
+  device = sampledTemperature->getDevice();
 
-  ret = sensor_channel_get(this->device, SENSOR_CHAN_DIE_TEMP, &value);
-  if (ret) {
-    LOG_ERR("Failed to get data (%d)\n", ret);
-    return 0;
+  // Conversions only, the fraction changes on every pass so that nothing is computed once
+  startCycles = k_cycle_get_32();
+  for (index = 0; index < TEMPERATURE_BENCHMARK_CONVERSIONS; index++) {
+    value.val1 = 25;
+    value.val2 = (int32_t)(index * 97);
+    benchmarkSink = (int32_t)(sensor_value_to_double(&value) * 1000);
   }
+  doubleCycles = k_cycle_get_32() - startCycles;
 
-  return sensor_value_to_double(&value);
-}
\ No newline at end of file
+  startCycles = k_cycle_get_32();
+  for (index = 0; index < TEMPERATURE_BENCHMARK_CONVERSIONS; index++) {
+    value.val1 = 25;
+    value.val2 = (int32_t)(index * 97);
+    benchmarkSink = Temperature::toMilliCelsius(&value);
+  }
+  fixedCycles = k_cycle_get_32() - startCycles;
+
+  // Whole samples, fetch included, as the previous read() and as measure() without oversampling
+  startCycles = k_cycle_get_32();
+  for (index = 0; index < TEMPERATURE_BENCHMARK_SAMPLES; index++) {
+    ret = sensor_sample_fetch(device);
+    ret = (ret == 0) ? sensor_channel_get(device, SENSOR_CHAN_DIE_TEMP, &value) : ret;
+    benchmarkSink = (int32_t)(sensor_value_to_double(&value) * 1000);
+  }
+  doubleSampleCycles = k_cycle_get_32() - startCycles;
+
+  startCycles = k_cycle_get_32();
+  for (index = 0; index < TEMPERATURE_BENCHMARK_SAMPLES; index++) {
+    ret = sensor_sample_fetch(device);
+    ret = (ret == 0) ? sensor_channel_get(device, SENSOR_CHAN_DIE_TEMP, &value) : ret;
+    milliCelsius = Temperature::toMilliCelsius(&value);
+    benchmarkSink = milliCelsius;
+  }
+  fixedSampleCycles = k_cycle_get_32() - startCycles;
+
+  if (ret < 0) {
+    shell_error(shell, "Failed to fetch samples (%d)", ret);
+    return ret;
+  }
+
+  shell_print(shell, "%-12s %16s %16s", "Path", "Cycles/convert", "Cycles/sample");
+  shell_print(shell, "%-12s %16d %16d", "double",
+              doubleCycles / TEMPERATURE_BENCHMARK_CONVERSIONS,
+              doubleSampleCycles / TEMPERATURE_BENCHMARK_SAMPLES);
+  shell_print(shell, "%-12s %16d %16d", "fixed-point",
+              fixedCycles / TEMPERATURE_BENCHMARK_CONVERSIONS,
+              fixedSampleCycles / TEMPERATURE_BENCHMARK_SAMPLES);
+
+  return 0;
+}
+#endif // CONFIG_TEMPERATURE_BENCHMARK
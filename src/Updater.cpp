@@ -1,6 +1,8 @@
 // Lib C includes
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 // Zephyr includes
@@ -11,75 +13,294 @@
 #include <zephyr/zbus/zbus.h>
 #include <zephyr/dfu/mcuboot.h>
 #include <zephyr/dfu/flash_img.h>
+#include <zephyr/drivers/flash.h>
 #include <zephyr/storage/flash_map.h>
+#include <zephyr/storage/stream_flash.h>
 #include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/sys/crc.h>
 #include <zephyr/logging/log.h>
+#include <mbedtls/sha256.h>
 LOG_MODULE_REGISTER(Updater);
 
 // User C++ class headers
 #include "EventManager.h"
 #include "HttpClient.h"
+#include "Storage.h"
+#include "SlotEraser.h"
+#include "BootTracer.h"
+#ifdef CONFIG_UPDATER_PARALLEL_DOWNLOAD
+#include "RangeDownloader.h"
+#endif // CONFIG_UPDATER_PARALLEL_DOWNLOAD
+#ifdef CONFIG_UPDATER_FLASH_PIPELINE
+#include "FlashPipeline.h"
+#endif // CONFIG_UPDATER_FLASH_PIPELINE
+#ifdef CONFIG_UPDATER_DELTA
+#include "DeltaPatcher.h"
+#endif // CONFIG_UPDATER_DELTA
+#ifdef CONFIG_UPDATER_COMPRESSED_IMAGE
+#include "HeatshrinkDecoder.h"
+#endif // CONFIG_UPDATER_COMPRESSED_IMAGE
+
+static constexpr size_t UPDATER_HASH_SIZE = 32;
+
+// Download progress persisted in NVS so that an interrupted download can be resumed. The image is
+// identified by its URL, its manifest hash (zeros without a manifest) and the entity tag the server
+// gave it, progress saved for another image is discarded
+typedef struct {
+  uint32_t imageSize;
+  uint32_t bytesWritten;
+  uint32_t urlHash;
+  uint8_t imageHash[UPDATER_HASH_SIZE];
+  char etag[HTTP_CLIENT_ETAG_MAX_LENGTH];
+} download_progress_t;
 
 // Function declarations
 static void updaterThreadHandler();
-static void onNetworkAvailableAction();
-static void startOtaUpdateAction();
-static void downloadImage(const char *host, const char *endpoint);
+static void onNetworkAvailableAction(const event_message_t *message);
+static void onNetworkUnavailableAction(const event_message_t *message);
+static void startOtaUpdateAction(const event_message_t *message);
+static bool parseImageUrl(const char *url, char *host, size_t hostSize, const char **endpoint);
+static bool downloadImage(const char *host, const char *endpoint);
+static int downloadImageAttempt(const char *host, const char *endpoint);
+static uint32_t imageUrlHash(const char *host, const char *endpoint);
+static bool readDownloadProgress(const char *host, const char *endpoint, download_progress_t *progress);
+static int fetchManifest(const char *host, const char *endpoint);
+static void onManifestFragment(HttpResponse *response);
+static int restartImageHash(size_t offset);
+static int verifyImageHash();
+#ifdef CONFIG_UPDATER_DELTA
+static int downloadPatch(const char *host);
+static void onPatchFragment(HttpResponse *response);
+#endif // CONFIG_UPDATER_DELTA
+#ifdef CONFIG_UPDATER_COMPRESSED_IMAGE
+static int downloadCompressedImage(const char *host);
+static void onCompressedFragment(HttpResponse *response);
+#endif // CONFIG_UPDATER_COMPRESSED_IMAGE
+static int seekFlashContext(size_t offset);
+static void onImageFragment(HttpResponse *response);
+static int commitImageData(const uint8_t *data, size_t length, bool flush);
+static void saveDownloadProgress();
 static bool confirmCurrentImage();
+static void startSlotEraser();
+static void verifyReadbackAction(const event_message_t *message);
 static int shellUpdateCommandHandler(const struct shell *shell, size_t argc, char **argv);
+static int shellUpdateVerifyCommandHandler(const struct shell *shell, size_t argc, char **argv);
+#ifdef CONFIG_UPDATER_PARALLEL_DOWNLOAD
+static void benchmarkDownloadAction(const event_message_t *message);
+static int shellUpdateBenchCommandHandler(const struct shell *shell, size_t argc, char **argv);
+#endif // CONFIG_UPDATER_PARALLEL_DOWNLOAD
 static void drawProgressBar(uint32_t total, uint32_t progress);
 
-// ZBUS subscribers definition
-ZBUS_SUBSCRIBER_DEFINE(updaterSubscriber, 4);
+// Every event is queued, a burst published while an update runs is not lost
+EVENT_QUEUE_DEFINE(updaterQueue, 16);
 
-// Add a subscriber observer to ZBUS events channel
-ZBUS_CHAN_ADD_OBS(eventsChannel, updaterSubscriber, 4);
+// Only the channels the updater reacts to wake it up
+ZBUS_CHAN_ADD_OBS(networkChannel, updaterQueueListener, 4);
+ZBUS_CHAN_ADD_OBS(buttonChannel, updaterQueueListener, 4);
+ZBUS_CHAN_ADD_OBS(otaChannel, updaterQueueListener, 4);
 
 // Thread definition
-K_THREAD_DEFINE(updaterThread, 1024*8, updaterThreadHandler, NULL, NULL, NULL, 7, 0, 0);
+K_THREAD_DEFINE(updaterThread, CONFIG_UPDATER_THREAD_STACK_SIZE, updaterThreadHandler, NULL, NULL, NULL, 7, 0, 0);
 
 // Shell command registration
-SHELL_CMD_ARG_REGISTER(update, NULL, "Start OTA update process", shellUpdateCommandHandler, 1, 0);
+#ifdef CONFIG_UPDATER_PARALLEL_DOWNLOAD
+SHELL_STATIC_SUBCMD_SET_CREATE(
+  updateSubcommands,
+  SHELL_CMD(bench, NULL, "Measure download throughput for 1..N streams", shellUpdateBenchCommandHandler),
+  SHELL_CMD(verify, NULL, "Time a read-back SHA-256 check of slot1 against the streamed one", shellUpdateVerifyCommandHandler),
+  SHELL_SUBCMD_SET_END
+);
+#else
+SHELL_STATIC_SUBCMD_SET_CREATE(
+  updateSubcommands,
+  SHELL_CMD(verify, NULL, "Time a read-back SHA-256 check of slot1 against the streamed one", shellUpdateVerifyCommandHandler),
+  SHELL_SUBCMD_SET_END
+);
+#endif // CONFIG_UPDATER_PARALLEL_DOWNLOAD
+SHELL_CMD_ARG_REGISTER(update, &updateSubcommands, "Start OTA update process", shellUpdateCommandHandler, 1, 1);
 
 // Event-Action pairs
-static const event_action_pair_t eventActionList[] {
-  {EVENT_OTA_UPDATE_SHELL_CMD, startOtaUpdateAction    },
-  {EVENT_BUTTON_PRESSED,       startOtaUpdateAction    },
-  {EVENT_NETWORK_AVAILABLE,    onNetworkAvailableAction},
+static constexpr event_action_pair_t eventActionList[] {
+  {EVENT_OTA_UPDATE_SHELL_CMD,    startOtaUpdateAction    },
+  {EVENT_BUTTON_PRESSED,          startOtaUpdateAction    },
+  {EVENT_NETWORK_AVAILABLE,       onNetworkAvailableAction},
+  {EVENT_NETWORK_UNAVAILABLE,     onNetworkUnavailableAction},
+  {EVENT_OTA_VERIFY_SHELL_CMD,    verifyReadbackAction    },
+#ifdef CONFIG_UPDATER_PARALLEL_DOWNLOAD
+  {EVENT_OTA_BENCHMARK_SHELL_CMD, benchmarkDownloadAction },
+#endif // CONFIG_UPDATER_PARALLEL_DOWNLOAD
 };
+static constexpr EventDispatchTable eventDispatchTable(eventActionList);
+
+// Events handled per wakeup of the updater thread
+static constexpr size_t UPDATER_EVENT_BATCH_SIZE = 4;
+
+// Image downloaded when the update request doesn't name one
+static constexpr const char *UPDATER_DEFAULT_HOST = CONFIG_UPDATER_SERVER;
+static constexpr const char *UPDATER_DEFAULT_IMAGE = CONFIG_UPDATER_IMAGE_PATH;
+
+// Number of download attempts before giving up, each one resumes where the previous one stopped
+static constexpr uint32_t UPDATER_DOWNLOAD_MAX_ATTEMPTS = 5;
+static constexpr uint32_t UPDATER_DOWNLOAD_RETRY_DELAY_MS = 2000;
+// Progress is persisted at most once per interval to limit the wear of the storage partition
+static constexpr uint32_t UPDATER_PROGRESS_SAVE_INTERVAL = 64 * 1024;
+
+// Published next to each image: SHA-256 in hex and size in bytes, separated by a space
+static constexpr const char *UPDATER_MANIFEST_SUFFIX = ".manifest";
+static constexpr size_t UPDATER_MANIFEST_MAX_LENGTH = 96;
+// Slot1 bytes read at once when the hash of a resumed download is rebuilt
+static constexpr size_t UPDATER_HASH_READ_SIZE = 256;
 
 static volatile bool networkIsAvailable = false;
 static struct flash_img_context flashContext = {0};
 static size_t totalDownloadSize = 0;
 static size_t currentDownloadedSize = 0;
-#ifdef VERIFY_DOWNLOADED_IMAGE_HASH
-static struct flash_img_check flashImageCheck = {0};
-#endif // VERIFY_DOWNLOADED_IMAGE_HASH
+static size_t resumeOffset = 0;
+static size_t lastSavedOffset = 0;
+// Saved with the progress, see download_progress_t
+static uint32_t downloadUrlHash = 0;
+static char downloadEtag[HTTP_CLIENT_ETAG_MAX_LENGTH] = {0};
+// Offset in slot1 of the next byte handed to the flash context, its sector must be erased first
+static size_t writeOffset = 0;
+static bool responseChecked = false;
+static bool downloadFailed = false;
+static bool downloadCompleted = false;
+static uint32_t fragmentCount = 0;
+#ifdef CONFIG_UPDATER_FLASH_PIPELINE
+static FlashPipeline flashPipeline;
+// Set while fragments are received straight into the pipeline slots
+static bool receivingInPlace = false;
+#else
+static uint8_t receiveBuffer[CONFIG_UPDATER_RECEIVE_BUFFER_SIZE] __aligned(4);
+#endif // CONFIG_UPDATER_FLASH_PIPELINE
+// Expected image from the manifest, the SHA-256 of what is committed to slot1 is updated as it is
+// written and compared with it once the download is complete
+static char manifest[UPDATER_MANIFEST_MAX_LENGTH] = {0};
+static size_t manifestLength = 0;
+static uint16_t manifestStatusCode = 0;
+static bool manifestAvailable = false;
+static uint8_t expectedImageHash[UPDATER_HASH_SIZE] = {0};
+static size_t expectedImageSize = 0;
+static mbedtls_sha256_context imageHashContext;
+static size_t hashedSize = 0;
+static uint64_t hashCycles = 0;
+// Version of the running image, patches are published against it
+static struct mcuboot_img_sem_ver runningVersion = {0};
+#ifdef CONFIG_UPDATER_DELTA
+static DeltaPatcher deltaPatcher(FIXED_PARTITION_ID(slot0_partition));
+#endif // CONFIG_UPDATER_DELTA
+#ifdef CONFIG_UPDATER_COMPRESSED_IMAGE
+static HeatshrinkDecoder imageDecoder;
+#endif // CONFIG_UPDATER_COMPRESSED_IMAGE
+#if defined(CONFIG_UPDATER_DELTA) || defined(CONFIG_UPDATER_COMPRESSED_IMAGE)
+// Status of the patch or compressed image response, a 404 means that none is published
+static uint16_t optionalStatusCode = 0;
+#endif // CONFIG_UPDATER_DELTA || CONFIG_UPDATER_COMPRESSED_IMAGE
 
 static void updaterThreadHandler() {
   int ret = 0;
-  event_t event = {.id = EVENT_INITIAL_VALUE};
+  event_message_t messages[UPDATER_EVENT_BATCH_SIZE] = {};
 
+  mbedtls_sha256_init(&imageHashContext);
   if (confirmCurrentImage() == false) {
     LOG_ERR("Failed to confirm current image");
     while (true) { k_msleep(1000); }
   }
+  BootTracer::getInstance().mark(BootMilestone::IMAGE_CONFIRMED);
+  startSlotEraser();
+  BootTracer::getInstance().mark(BootMilestone::UPDATER_READY);
   while (true) {
-    ret = waitForEvent(&updaterSubscriber, &event, K_FOREVER);
-    if (ret == 0) {
-      processEvent(&event, eventActionList, EVENT_ACTION_LIST_SIZE(eventActionList));
+    // Events queued while an update was running are all handled after a single wakeup
+    ret = waitForEvents(&updaterQueue, messages, ARRAY_SIZE(messages), K_FOREVER);
+    if (ret > 0) {
+      processEvents(messages, (size_t)ret, eventDispatchTable);
     }
   }
 }
 
-static void onNetworkAvailableAction() {
-  LOG_INF("Network is now available");
+static void onNetworkAvailableAction(const event_message_t *message) {
+  LOG_INF("Network is now available (%s)", message->network.ipAddress);
   networkIsAvailable = true;
 }
 
-static void startOtaUpdateAction() {
+static void onNetworkUnavailableAction(const event_message_t *message) {
+  ARG_UNUSED(message);
+
+  LOG_INF("Network is no longer available");
+  networkIsAvailable = false;
+}
+
+static void startOtaUpdateAction(const event_message_t *message) {
+  int ret = -ENOENT;
+  char host[EVENT_URL_MAX_LENGTH] = {0};
+  const char *endpoint = UPDATER_DEFAULT_IMAGE;
+  bool defaultImage = true;
+  int64_t startTime = 0;
+  slot_eraser_stats_t eraserStats = {0};
+
+  strncpy(host, UPDATER_DEFAULT_HOST, sizeof(host) - 1);
+  if ((message->event.id == EVENT_OTA_UPDATE_SHELL_CMD) && (message->ota.url[0] != '\0')) {
+    if (!parseImageUrl(message->ota.url, host, sizeof(host), &endpoint)) {
+      LOG_ERR("Invalid image URL: %s", message->ota.url);
+      return;
+    }
+    defaultImage = false;
+  }
+
   if (networkIsAvailable) {
-    downloadImage("192.168.1.25", "/zephyr.signed.bin");
+    startTime = k_uptime_get();
+    // Every way of getting the image writes the same bytes to slot1, they are all checked against it
+    ret = fetchManifest(host, endpoint);
+    if (ret == -ENOENT) {
+      LOG_WRN("No manifest published for %s, the image will only be checked by MCUboot", endpoint);
+    } else if (ret < 0) {
+      LOG_ERR("Failed to get the manifest of %s (%d)", endpoint, ret);
+      return;
+    }
+    ret = -ENOENT;
+#ifdef CONFIG_UPDATER_DELTA
+    // Patches are only published for the default image, the full image is the fallback
+    if (defaultImage) {
+      ret = downloadPatch(host);
+      if ((ret < 0) && (ret != -ENOENT) && (ret != -EALREADY)) {
+        LOG_WRN("Failed to apply the patch (%d), downloading the full image", ret);
+      }
+    }
+#endif // CONFIG_UPDATER_DELTA
+#ifdef CONFIG_UPDATER_COMPRESSED_IMAGE
+    // Same for the compressed image, an image URL always downloads the raw image it names
+    if (defaultImage && (ret < 0)) {
+      ret = downloadCompressedImage(host);
+      if ((ret < 0) && (ret != -ENOENT) && (ret != -EALREADY)) {
+        LOG_WRN("Failed to decompress the image (%d), downloading the raw image", ret);
+      }
+    }
+#endif // CONFIG_UPDATER_COMPRESSED_IMAGE
+#if !defined(CONFIG_UPDATER_DELTA) && !defined(CONFIG_UPDATER_COMPRESSED_IMAGE)
+    ARG_UNUSED(defaultImage);
+#endif // !CONFIG_UPDATER_DELTA && !CONFIG_UPDATER_COMPRESSED_IMAGE
+    if (ret < 0) {
+      LOG_INF("Downloading http://%s%s", host, endpoint);
+      if (!downloadImage(host, endpoint)) {
+        LOG_ERR("Failed to download the new image");
+        return;
+      }
+    }
+    if (verifyImageHash() < 0) {
+      LOG_ERR("Downloaded image doesn't match its manifest");
+      return;
+    }
+    LOG_INF("OTA update took %lld ms", k_uptime_get() - startTime);
+    SlotEraser::getInstance().getStats(&eraserStats);
+    LOG_INF("%d sectors erased during the update (%d ms)",
+            eraserStats.onDemandErases,
+            eraserStats.onDemandEraseTimeMs);
+    // The MCUboot trailer at the end of slot1 must be written to erased flash, like the image
+    if (SlotEraser::getInstance().finish() < 0) {
+      LOG_ERR("Failed to erase the rest of slot 1");
+      return;
+    }
     if (boot_request_upgrade(BOOT_UPGRADE_TEST)) {
       LOG_ERR("Failed to mark the image in slot 1 as pending");
       return;
@@ -90,73 +311,793 @@ static void startOtaUpdateAction() {
   }
 }
 
-static void downloadImage(const char *host, const char *endpoint) {
+#ifdef CONFIG_UPDATER_PARALLEL_DOWNLOAD
+static void benchmarkDownloadAction(const event_message_t *message) {
+  int ret = 0;
+  uint8_t streams = 0;
+  int64_t startTime = 0;
+  int64_t elapsedTime = 0;
+  static size_t benchmarkBytes = 0;
+  RangeDownloader downloader((char *)UPDATER_DEFAULT_HOST);
+
+  ARG_UNUSED(message);
+
+  if (!networkIsAvailable) {
+    LOG_WRN("Network is not available, cannot start benchmark");
+    return;
+  }
+
+  // Only the network is measured here, fragments are counted and dropped instead of written
+  for (streams = 1; streams <= CONFIG_UPDATER_DOWNLOAD_STREAMS; streams++) {
+    benchmarkBytes = 0;
+    startTime = k_uptime_get();
+    ret = downloader.download(UPDATER_DEFAULT_IMAGE, 0, streams, [](HttpResponse *response) {
+      benchmarkBytes += response->bodyLength;
+      return 0;
+    });
+    elapsedTime = MAX(k_uptime_get() - startTime, 1);
+    if (ret < 0) {
+      LOG_ERR("Benchmark with %d streams failed (%d)", streams, ret);
+      return;
+    }
+    LOG_INF("%d streams: %d bytes in %lld ms (%lld kB/s)",
+            streams,
+            benchmarkBytes,
+            elapsedTime,
+            (int64_t)benchmarkBytes / elapsedTime);
+  }
+}
+#endif // CONFIG_UPDATER_PARALLEL_DOWNLOAD
+
+// Split http://host/path (the scheme is optional) into the host and the endpoint
+static bool parseImageUrl(const char *url, char *host, size_t hostSize, const char **endpoint) {
+  const char *slash = NULL;
+  size_t hostLength = 0;
+
+  assert(url);
+  assert(host);
+  assert(endpoint);
+
+  if (strncmp(url, "http://", strlen("http://")) == 0) {
+    url += strlen("http://");
+  }
+
+  slash = strchr(url, '/');
+  if (slash == NULL) {
+    return false;
+  }
+  hostLength = (size_t)(slash - url);
+  if ((hostLength == 0) || (hostLength >= hostSize)) {
+    return false;
+  }
+
+  memcpy(host, url, hostLength);
+  host[hostLength] = '\0';
+  *endpoint = slash;
+
+  return true;
+}
+
+static bool downloadImage(const char *host, const char *endpoint) {
   int ret = 0;
+  uint32_t attempt = 0;
 
   assert(host);
   assert(endpoint);
 
+  for (attempt = 1; attempt <= UPDATER_DOWNLOAD_MAX_ATTEMPTS; attempt++) {
+    ret = downloadImageAttempt(host, endpoint);
+    if (ret == 0) {
+      return true;
+    }
+    LOG_WRN("Download attempt %d/%d failed (%d)", attempt, UPDATER_DOWNLOAD_MAX_ATTEMPTS, ret);
+    k_msleep(UPDATER_DOWNLOAD_RETRY_DELAY_MS);
+  }
+
+  return false;
+}
+
+static int downloadImageAttempt(const char *host, const char *endpoint) {
+  int ret = 0;
+  char rangeHeader[32] = {0};
+  char ifRangeHeader[HTTP_CLIENT_ETAG_MAX_LENGTH + 16] = {0};
+  const char *headers[] = {rangeHeader, NULL, NULL};
+  HttpRequestOptions options = {.headers = headers, .timeoutMs = CONFIG_UPDATER_DOWNLOAD_TIMEOUT_MS};
+  download_progress_t progress = {0};
+  int64_t startTime = 0;
+  int64_t elapsedTime = 0;
+
   HttpClient client((char *)host);
+#ifdef CONFIG_UPDATER_PARALLEL_DOWNLOAD
+  RangeDownloader downloader((char *)host);
+#endif // CONFIG_UPDATER_PARALLEL_DOWNLOAD
+
+  // Resume from the last offset known to be committed to slot1, if any, for this same image
+  downloadUrlHash = imageUrlHash(host, endpoint);
+  if (readDownloadProgress(host, endpoint, &progress)) {
+    totalDownloadSize = progress.imageSize;
+    resumeOffset = SlotEraser::getInstance().resumableOffset(progress.bytesWritten);
+    memcpy(downloadEtag, progress.etag, sizeof(downloadEtag));
+    if (resumeOffset == 0) {
+      downloadEtag[0] = '\0';
+    }
+  } else {
+    totalDownloadSize = 0;
+    resumeOffset = 0;
+    downloadEtag[0] = '\0';
+  }
+  currentDownloadedSize = resumeOffset;
+  lastSavedOffset = resumeOffset;
+  responseChecked = false;
+  downloadFailed = false;
+  downloadCompleted = false;
+  fragmentCount = 0;
 
   // Initialize context needed for writing the image to the flash
-  ret = flash_img_init(&flashContext);
+  ret = seekFlashContext(resumeOffset);
   if (ret < 0) {
     LOG_ERR("Flash context init error: %d", ret);
-    return;
+    return ret;
+  }
+#ifdef CONFIG_UPDATER_FLASH_PIPELINE
+  flashPipeline.start(commitImageData);
+#endif // CONFIG_UPDATER_FLASH_PIPELINE
+
+  if (resumeOffset > 0) {
+    LOG_INF("Resuming download at %.3f kb", (float)resumeOffset / 1024);
+    snprintk(rangeHeader, sizeof(rangeHeader), "Range: bytes=%zu-\r\n", resumeOffset);
+    // The server sends the whole image instead when it changed since the progress was saved
+    if (downloadEtag[0] != '\0') {
+      snprintk(ifRangeHeader, sizeof(ifRangeHeader), "If-Range: %s\r\n", downloadEtag);
+      headers[1] = ifRangeHeader;
+    }
+  } else {
+    headers[0] = NULL;
   }
 
   // Download image
-  client.get(endpoint, [](HttpResponse *response) {
-    int ret = 0;
-    size_t totalSizeWrittenToFlash = 0;
+  ret = -ENOTSUP;
+  startTime = k_uptime_get();
+#ifdef CONFIG_UPDATER_PARALLEL_DOWNLOAD
+  ret = downloader.download(endpoint, resumeOffset, CONFIG_UPDATER_DOWNLOAD_STREAMS, [](HttpResponse *response) {
+    onImageFragment(response);
+    return downloadFailed ? -EIO : 0;
+  }, (downloadEtag[0] != '\0') ? downloadEtag : NULL);
+  // Ranges already written can't be taken over by a single stream, the next attempt resumes them
+  if ((ret == -ENOTSUP) && responseChecked) {
+    ret = -EIO;
+  }
+#endif // CONFIG_UPDATER_PARALLEL_DOWNLOAD
+  // Fall back to a single stream when the server doesn't support range requests
+  if (ret == -ENOTSUP) {
+#ifdef CONFIG_UPDATER_FLASH_PIPELINE
+    // Receive straight into the pipeline slots, each filled slot is queued for writing as is
+    options.buffer = flashPipeline.acquire(&options.bufferSize);
+    options.nextBuffer = [](size_t *bufferSize) {
+      return flashPipeline.acquire(bufferSize);
+    };
+    receivingInPlace = true;
+#else
+    options.buffer = receiveBuffer;
+    options.bufferSize = sizeof(receiveBuffer);
+#endif // CONFIG_UPDATER_FLASH_PIPELINE
+    ret = client.get(endpoint, onImageFragment, &options);
+#ifdef CONFIG_UPDATER_FLASH_PIPELINE
+    receivingInPlace = false;
+#endif // CONFIG_UPDATER_FLASH_PIPELINE
+  }
 
-    if (totalDownloadSize == 0) {
+  if (downloadCompleted) {
+    elapsedTime = MAX(k_uptime_get() - startTime, 1);
+    LOG_INF("Downloaded %d bytes in %lld ms (%lld kB/s)",
+            totalDownloadSize - resumeOffset,
+            elapsedTime,
+            (int64_t)(totalDownloadSize - resumeOffset) / elapsedTime);
+    LOG_INF("Image received in %d fragments", fragmentCount);
+#ifdef CONFIG_UPDATER_FLASH_PIPELINE
+    LOG_INF("Flash writer busy for %d ms, network stalled for %d ms",
+            flashPipeline.writeTimeMs,
+            flashPipeline.stallTimeMs);
+#endif // CONFIG_UPDATER_FLASH_PIPELINE
+    // Nothing left to resume
+    Storage::getInstance().remove(STORAGE_ID_DOWNLOAD_PROGRESS);
+    totalDownloadSize = 0;
+    currentDownloadedSize = 0;
+    return 0;
+  }
+
+  // Keep what has already been committed to flash for the next attempt
+  printk("\r\n");
+#ifdef CONFIG_UPDATER_FLASH_PIPELINE
+  flashPipeline.drain();
+#endif // CONFIG_UPDATER_FLASH_PIPELINE
+  saveDownloadProgress();
+
+  return (ret < 0) ? ret : -EIO;
+}
+
+static uint32_t imageUrlHash(const char *host, const char *endpoint) {
+  uint32_t hash = 0;
+
+  hash = crc32_ieee((const uint8_t *)host, strlen(host));
+  return crc32_ieee_update(hash, (const uint8_t *)endpoint, strlen(endpoint));
+}
+
+// False when no download of this image was interrupted, the progress of another image is discarded
+// since the next download overwrites slot1 anyway
+static bool readDownloadProgress(const char *host, const char *endpoint, download_progress_t *progress) {
+  uint8_t imageHash[UPDATER_HASH_SIZE] = {0};
+
+  assert(host);
+  assert(endpoint);
+  assert(progress);
+
+  if (Storage::getInstance().read(STORAGE_ID_DOWNLOAD_PROGRESS, progress, sizeof(*progress)) !=
+      sizeof(*progress)) {
+    return false;
+  }
+
+  if (manifestAvailable) {
+    memcpy(imageHash, expectedImageHash, sizeof(imageHash));
+  }
+  if ((progress->urlHash != imageUrlHash(host, endpoint)) ||
+      (memcmp(progress->imageHash, imageHash, sizeof(imageHash)) != 0)) {
+    LOG_WRN("Saved progress is for another image, downloading from the beginning");
+    Storage::getInstance().remove(STORAGE_ID_DOWNLOAD_PROGRESS);
+    return false;
+  }
+  progress->etag[sizeof(progress->etag) - 1] = '\0';
+
+  return true;
+}
+
+static void onImageFragment(HttpResponse *response) {
+  int ret = 0;
+  size_t totalSizeWrittenToFlash = 0;
+
+  if (downloadFailed) {
+    return;
+  }
+
+  // First fragment: make sure the server continues the same image where we stopped
+  if (!responseChecked) {
+    responseChecked = true;
+    if ((response->statusCode == 206) && (response->rangeStart == resumeOffset) &&
+        ((resumeOffset == 0) || (response->rangeTotal == totalDownloadSize)) &&
+        ((downloadEtag[0] == '\0') || (response->etag && (strcmp(response->etag, downloadEtag) == 0)))) {
+      totalDownloadSize = response->rangeTotal;
+      LOG_INF("Server sent the image from offset %d", resumeOffset);
+    } else if (response->statusCode == 200) {
+      if (resumeOffset > 0) {
+        LOG_WRN("Server sent the whole image, restarting download from the beginning");
+        // Nothing has been queued to the flash pipeline yet, the context can safely be reset
+        ret = seekFlashContext(0);
+        if (ret < 0) {
+          LOG_ERR("Flash context init error: %d", ret);
+          downloadFailed = true;
+          return;
+        }
+        resumeOffset = 0;
+        currentDownloadedSize = 0;
+        lastSavedOffset = 0;
+      }
       totalDownloadSize = response->totalSize;
       LOG_INF("Image size to download: %.3f kb", (float)totalDownloadSize / 1024);
+    } else {
+      LOG_ERR("Unexpected response (status %d, range %d/%d)",
+              response->statusCode,
+              response->rangeStart,
+              response->rangeTotal);
+      // The image changed on the server, the next attempt starts over
+      Storage::getInstance().remove(STORAGE_ID_DOWNLOAD_PROGRESS);
+      totalDownloadSize = 0;
+      downloadFailed = true;
+      return;
     }
+    // Saved with the progress so that the next attempt only resumes this version of the image
+    if (response->etag) {
+      strncpy(downloadEtag, response->etag, sizeof(downloadEtag) - 1);
+    } else {
+      downloadEtag[0] = '\0';
+    }
+    // Nothing has been written yet, an image that doesn't match the manifest is rejected right away
+    if (manifestAvailable && (totalDownloadSize != expectedImageSize)) {
+      LOG_ERR("Server sent a %d bytes image, the manifest expects %d bytes",
+              totalDownloadSize,
+              expectedImageSize);
+      Storage::getInstance().remove(STORAGE_ID_DOWNLOAD_PROGRESS);
+      totalDownloadSize = 0;
+      downloadFailed = true;
+      return;
+    }
+  }
+
+  fragmentCount++;
+#ifdef CONFIG_UPDATER_FLASH_PIPELINE
+  if (receivingInPlace) {
+    ret = flashPipeline.commit(response->body, response->bodyLength, response->isComplete);
+  } else {
+    ret = flashPipeline.write(response->body, response->bodyLength, response->isComplete);
+  }
+#else
+  ret = commitImageData(response->body, response->bodyLength, response->isComplete);
+#endif // CONFIG_UPDATER_FLASH_PIPELINE
+  if (ret < 0) {
+    LOG_ERR("Flash write error: %d", ret);
+    downloadFailed = true;
+    return;
+  }
 
-    ret = flash_img_buffered_write(&flashContext,
-                                   response->body,
-                                   response->bodyLength,
-                                   (response->isComplete));
+  currentDownloadedSize += response->bodyLength;
+  drawProgressBar(totalDownloadSize, currentDownloadedSize);
+
+  if (response->isComplete) {
+#ifdef CONFIG_UPDATER_FLASH_PIPELINE
+    // The flash context can only be inspected once the writer thread is done with it
+    ret = flashPipeline.drain();
     if (ret < 0) {
-      LOG_ERR("Flash write error: %d", ret);
-      totalDownloadSize = 0;
-      currentDownloadedSize = 0;
+      downloadFailed = true;
       return;
     }
+#endif // CONFIG_UPDATER_FLASH_PIPELINE
+    totalSizeWrittenToFlash = resumeOffset + flash_img_bytes_written(&flashContext);
+    if ((currentDownloadedSize == totalDownloadSize) &&
+        (totalDownloadSize == totalSizeWrittenToFlash)) {
+        printk("✅\r\n");
+      LOG_INF("Download completed successfully");
+      downloadCompleted = true;
+    } else {
+      printk("❌\r\n");
+      LOG_ERR("The size written to flash is different than the one downloaded");
+      LOG_INF("totalDownloadSize=%d", totalDownloadSize);
+      LOG_INF("currentDownloadedSize=%d", currentDownloadedSize);
+      LOG_INF("totalSizeWrittenToFlash=%d", totalSizeWrittenToFlash);
+      downloadFailed = true;
+    }
+  }
+}
 
-    currentDownloadedSize += response->bodyLength;
-    drawProgressBar(totalDownloadSize, currentDownloadedSize);
+#ifdef CONFIG_UPDATER_DELTA
+static int downloadPatch(const char *host) {
+  int ret = 0;
+  char endpoint[64] = {0};
+  download_progress_t progress = {0};
+  int64_t startTime = 0;
+  int64_t elapsedTime = 0;
+  // The slot0 check and the rebuild happen in the fragment callbacks, within the request timeout
+  HttpRequestOptions options = {.timeoutMs = CONFIG_UPDATER_DOWNLOAD_TIMEOUT_MS};
 
-    if (response->isComplete) {
-      totalSizeWrittenToFlash = flash_img_bytes_written(&flashContext);
-      if ((currentDownloadedSize == totalDownloadSize) &&
-          (totalDownloadSize == totalSizeWrittenToFlash)) {
-          printk("✅\r\n");
-        LOG_INF("Download completed successfully");
-        totalDownloadSize = 0;
-        currentDownloadedSize = 0;
-#ifdef VERIFY_DOWNLOADED_IMAGE_HASH
-        // Verify the hash of the stored firmware
-        flashImageCheck.match = fileHash;
-        flashImageCheck.clen = totalDownloadSize;
-        if (flash_img_check(&flashContext, &flashImageCheck, FIXED_PARTITION_ID(slot1_partition))) {
-          LOG_ERR("Firmware - flash validation has failed");
-          return;
-        }
-#endif // VERIFY_DOWNLOADED_IMAGE_HASH
-      } else {
-        printk("❌\r\n");
-        LOG_ERR("The size written to flash is different than the one downloaded");
-        LOG_INF("totalDownloadSize=%d", totalDownloadSize);
-        LOG_INF("currentDownloadedSize=%d", currentDownloadedSize);
-        LOG_INF("totalSizeWrittenToFlash=%d", totalSizeWrittenToFlash);
-        totalDownloadSize = 0;
-        currentDownloadedSize = 0;
-      }
+  HttpClient client((char *)host);
+
+  // Resuming an interrupted full download is cheaper than starting over with a patch
+  if (readDownloadProgress(host, UPDATER_DEFAULT_IMAGE, &progress)) {
+    return -EALREADY;
+  }
+
+  snprintk(endpoint, sizeof(endpoint), "%s/%d.%d.%d+%d.bin",
+           CONFIG_UPDATER_DELTA_PATH,
+           runningVersion.major,
+           runningVersion.minor,
+           runningVersion.revision,
+           runningVersion.build_num);
+
+  // A patch can't be resumed, with an image size of 0 commitImageData() never saves any progress
+  totalDownloadSize = 0;
+  currentDownloadedSize = 0;
+  resumeOffset = 0;
+  lastSavedOffset = 0;
+  downloadFailed = false;
+  optionalStatusCode = 0;
+
+  ret = seekFlashContext(0);
+  if (ret < 0) {
+    LOG_ERR("Flash context init error: %d", ret);
+    return ret;
+  }
+  ret = deltaPatcher.start(commitImageData);
+  if (ret < 0) {
+    return ret;
+  }
+
+  startTime = k_uptime_get();
+  ret = client.get(endpoint, onPatchFragment, &options);
+  if (ret < 0) {
+    return ret;
+  }
+  if (optionalStatusCode == 404) {
+    LOG_INF("No patch published for version %d.%d.%d+%d",
+            runningVersion.major,
+            runningVersion.minor,
+            runningVersion.revision,
+            runningVersion.build_num);
+    return -ENOENT;
+  }
+  if (downloadFailed) {
+    printk("\r\n");
+    return -EIO;
+  }
+
+  ret = deltaPatcher.finish();
+  if (ret < 0) {
+    return ret;
+  }
+
+  elapsedTime = MAX(k_uptime_get() - startTime, 1);
+  printk("\r\n");
+  LOG_INF("Image of %d bytes rebuilt from a %d bytes patch in %lld ms",
+          deltaPatcher.targetSize,
+          currentDownloadedSize,
+          elapsedTime);
+  currentDownloadedSize = 0;
+
+  return 0;
+}
+
+static void onPatchFragment(HttpResponse *response) {
+  int ret = 0;
+
+  if (downloadFailed) {
+    return;
+  }
+
+  optionalStatusCode = response->statusCode;
+  if (response->statusCode != 200) {
+    downloadFailed = true;
+    return;
+  }
+
+  ret = deltaPatcher.write(response->body, response->bodyLength);
+  if (ret < 0) {
+    downloadFailed = true;
+    return;
+  }
+
+  currentDownloadedSize += response->bodyLength;
+  if (response->totalSize > 0) {
+    drawProgressBar(response->totalSize, currentDownloadedSize);
+  }
+}
+#endif // CONFIG_UPDATER_DELTA
+
+#ifdef CONFIG_UPDATER_COMPRESSED_IMAGE
+static int downloadCompressedImage(const char *host) {
+  int ret = 0;
+  download_progress_t progress = {0};
+  int64_t startTime = 0;
+  int64_t elapsedTime = 0;
+  // Decoding and flash writes happen in the fragment callbacks, within the request timeout
+  HttpRequestOptions options = {.timeoutMs = CONFIG_UPDATER_DOWNLOAD_TIMEOUT_MS};
+
+  HttpClient client((char *)host);
+
+  // The decoder state can't be restored, an interrupted raw download is resumed instead
+  if (readDownloadProgress(host, UPDATER_DEFAULT_IMAGE, &progress)) {
+    return -EALREADY;
+  }
+
+  // With an image size of 0 commitImageData() never saves any progress
+  totalDownloadSize = 0;
+  currentDownloadedSize = 0;
+  resumeOffset = 0;
+  lastSavedOffset = 0;
+  downloadFailed = false;
+  downloadCompleted = false;
+  optionalStatusCode = 0;
+
+  ret = seekFlashContext(0);
+  if (ret < 0) {
+    LOG_ERR("Flash context init error: %d", ret);
+    return ret;
+  }
+  imageDecoder.start(commitImageData);
+
+  startTime = k_uptime_get();
+  ret = client.get(CONFIG_UPDATER_COMPRESSED_IMAGE_PATH, onCompressedFragment, &options);
+  if (ret < 0) {
+    return ret;
+  }
+  if (optionalStatusCode == 404) {
+    LOG_INF("No compressed image published");
+    return -ENOENT;
+  }
+  if (downloadFailed) {
+    printk("\r\n");
+    return -EIO;
+  }
+  // A connection closed early ends the response too, the decoder can't tell a cut stream apart
+  if (!downloadCompleted) {
+    printk("\r\n");
+    LOG_ERR("Compressed image incomplete after %d bytes", currentDownloadedSize);
+    return -EIO;
+  }
+
+  ret = imageDecoder.finish();
+  if (ret < 0) {
+    LOG_ERR("Compressed image truncated (%d)", ret);
+    return ret;
+  }
+
+  elapsedTime = MAX(k_uptime_get() - startTime, 1);
+  printk("\r\n");
+  LOG_INF("Image of %d bytes decompressed from %d bytes on the wire (%d%%) in %lld ms",
+          imageDecoder.bytesWritten,
+          currentDownloadedSize,
+          (currentDownloadedSize * 100) / MAX(imageDecoder.bytesWritten, 1),
+          elapsedTime);
+  LOG_INF("Decompression took %d ms (%d kB/s), flash writes %d ms",
+          imageDecoder.decodeTimeMs,
+          imageDecoder.bytesWritten / MAX(imageDecoder.decodeTimeMs, 1),
+          imageDecoder.writeTimeMs);
+  currentDownloadedSize = 0;
+
+  return 0;
+}
+
+static void onCompressedFragment(HttpResponse *response) {
+  int ret = 0;
+
+  if (downloadFailed) {
+    return;
+  }
+
+  optionalStatusCode = response->statusCode;
+  if (response->statusCode != 200) {
+    downloadFailed = true;
+    return;
+  }
+
+  ret = imageDecoder.write(response->body, response->bodyLength);
+  if (ret < 0) {
+    downloadFailed = true;
+    return;
+  }
+
+  currentDownloadedSize += response->bodyLength;
+  if (response->totalSize > 0) {
+    drawProgressBar(response->totalSize, currentDownloadedSize);
+  }
+
+  if (response->isComplete) {
+    // Without a Content-Length the end of the stream is only checked by the decoder
+    if ((response->totalSize > 0) && (currentDownloadedSize != response->totalSize)) {
+      LOG_ERR("Received %d bytes of a %d bytes compressed image", currentDownloadedSize, response->totalSize);
+      downloadFailed = true;
+      return;
+    }
+    downloadCompleted = true;
+  }
+}
+#endif // CONFIG_UPDATER_COMPRESSED_IMAGE
+
+static int commitImageData(const uint8_t *data, size_t length, bool flush) {
+  int ret = 0;
+  uint32_t startCycles = 0;
+
+  // Sectors already erased in the background are skipped, writing is all that is left
+  ret = SlotEraser::getInstance().prepare(writeOffset, length);
+  if (ret < 0) {
+    return ret;
+  }
+
+  // Whatever the image comes from, it goes through here in order, so it is hashed here
+  if (manifestAvailable) {
+    if ((hashedSize + length) > expectedImageSize) {
+      LOG_ERR("Image is larger than the %d bytes of its manifest", expectedImageSize);
+      return -EFBIG;
     }
-  });
+    startCycles = k_cycle_get_32();
+    mbedtls_sha256_update(&imageHashContext, data, length);
+    hashCycles += k_cycle_get_32() - startCycles;
+    hashedSize += length;
+  }
+
+  ret = flash_img_buffered_write(&flashContext, data, length, flush);
+  if (ret < 0) {
+    return ret;
+  }
+  writeOffset += length;
+
+  if ((resumeOffset + flash_img_bytes_written(&flashContext)) >=
+      (lastSavedOffset + UPDATER_PROGRESS_SAVE_INTERVAL)) {
+    saveDownloadProgress();
+  }
+
+  return 0;
+}
+
+static int seekFlashContext(size_t offset) {
+  int ret = 0;
+  const struct device *flashDevice = NULL;
+  off_t flashOffset = 0;
+#ifdef CONFIG_STREAM_FLASH_ERASE
+  struct flash_pages_info pageInfo = {0};
+#endif // CONFIG_STREAM_FLASH_ERASE
+
+  ret = flash_img_init(&flashContext);
+  if (ret < 0) {
+    return ret;
+  }
+  // The image hash and the sectors being written follow the write position
+  writeOffset = offset;
+  SlotEraser::getInstance().seek(offset);
+  ret = restartImageHash(offset);
+  if ((ret < 0) || (offset == 0)) {
+    return ret;
+  }
+
+  // Move the write position of the underlying stream to the resume offset
+  flashDevice = flash_area_get_device(flashContext.flash_area);
+  flashOffset = flashContext.flash_area->fa_off + offset;
+  ret = stream_flash_init(&flashContext.stream,
+                          flashDevice,
+                          flashContext.buf,
+                          sizeof(flashContext.buf),
+                          flashOffset,
+                          flashContext.flash_area->fa_size - offset,
+                          NULL);
+  if (ret < 0) {
+    return ret;
+  }
+
+#ifdef CONFIG_STREAM_FLASH_ERASE
+  // The page holding the resume offset was already erased when it was first written to
+  ret = flash_get_page_info_by_offs(flashDevice, flashOffset, &pageInfo);
+  if (ret < 0) {
+    return ret;
+  }
+  flashContext.stream.last_erased_page_start_offset = pageInfo.start_offset;
+#endif // CONFIG_STREAM_FLASH_ERASE
+
+  return 0;
+}
+
+static void saveDownloadProgress() {
+  int ret = 0;
+  download_progress_t progress = {0};
+
+  // Only bytes flushed to flash count, the ones still buffered would be lost on failure, and an
+  // image size of 0 means that the previous progress has been invalidated
+  progress.imageSize = totalDownloadSize;
+  progress.bytesWritten = resumeOffset + flash_img_bytes_written(&flashContext);
+  if ((progress.imageSize == 0) || (progress.bytesWritten == 0)) {
+    return;
+  }
+  progress.urlHash = downloadUrlHash;
+  if (manifestAvailable) {
+    memcpy(progress.imageHash, expectedImageHash, sizeof(progress.imageHash));
+  }
+  memcpy(progress.etag, downloadEtag, sizeof(progress.etag));
+
+  ret = Storage::getInstance().write(STORAGE_ID_DOWNLOAD_PROGRESS, &progress, sizeof(progress));
+  if (ret < 0) {
+    LOG_WRN("Failed to save download progress (%d)", ret);
+    return;
+  }
+  lastSavedOffset = progress.bytesWritten;
+}
+
+static int fetchManifest(const char *host, const char *endpoint) {
+  int ret = 0;
+  char path[EVENT_URL_MAX_LENGTH + 16] = {0};
+  char *sizeEnd = NULL;
+
+  HttpClient client((char *)host);
+
+  manifestAvailable = false;
+  manifestLength = 0;
+  manifestStatusCode = 0;
+  memset(manifest, 0x00, sizeof(manifest));
+  snprintk(path, sizeof(path), "%s%s", endpoint, UPDATER_MANIFEST_SUFFIX);
+
+  ret = client.get(path, onManifestFragment);
+  if (ret < 0) {
+    return ret;
+  }
+  if (manifestStatusCode == 404) {
+    return -ENOENT;
+  }
+  if (manifestStatusCode != 200) {
+    return -EIO;
+  }
+
+  if ((manifestLength < ((2 * UPDATER_HASH_SIZE) + 2)) || (manifest[2 * UPDATER_HASH_SIZE] != ' ') ||
+      (hex2bin(manifest, 2 * UPDATER_HASH_SIZE, expectedImageHash, sizeof(expectedImageHash)) !=
+       UPDATER_HASH_SIZE)) {
+    LOG_ERR("Invalid manifest: %s", manifest);
+    return -EINVAL;
+  }
+  expectedImageSize = strtoul(&manifest[(2 * UPDATER_HASH_SIZE) + 1], &sizeEnd, 10);
+  if ((sizeEnd == &manifest[(2 * UPDATER_HASH_SIZE) + 1]) || (expectedImageSize == 0)) {
+    LOG_ERR("Invalid manifest: %s", manifest);
+    return -EINVAL;
+  }
+
+  manifestAvailable = true;
+  LOG_INF("Manifest expects a %d bytes image", expectedImageSize);
+
+  return 0;
+}
+
+static void onManifestFragment(HttpResponse *response) {
+  size_t length = 0;
+
+  manifestStatusCode = response->statusCode;
+  if (response->statusCode != 200) {
+    return;
+  }
+
+  // Anything past the buffer can't be a valid manifest, it is rejected when parsed
+  length = MIN(response->bodyLength, sizeof(manifest) - 1 - manifestLength);
+  memcpy(&manifest[manifestLength], response->body, length);
+  manifestLength += length;
+}
+
+static int restartImageHash(size_t offset) {
+  int ret = 0;
+  const struct flash_area *area = NULL;
+  size_t position = 0;
+  size_t chunk = 0;
+  uint8_t buffer[UPDATER_HASH_READ_SIZE] = {0};
+
+  hashedSize = 0;
+  hashCycles = 0;
+  if (!manifestAvailable) {
+    return 0;
+  }
+
+  mbedtls_sha256_starts(&imageHashContext, 0);
+  if (offset == 0) {
+    return 0;
+  }
+
+  // The hash state is not persisted with the progress, the part written before the interruption is
+  // read back once so that the rest of the image can be hashed as it arrives
+  ret = flash_area_open(FIXED_PARTITION_ID(slot1_partition), &area);
+  if (ret < 0) {
+    return ret;
+  }
+  for (position = 0; position < offset; position += chunk) {
+    chunk = MIN(offset - position, sizeof(buffer));
+    ret = flash_area_read(area, position, buffer, chunk);
+    if (ret < 0) {
+      LOG_ERR("Failed to read slot1 at %d (%d)", position, ret);
+      break;
+    }
+    mbedtls_sha256_update(&imageHashContext, buffer, chunk);
+  }
+  flash_area_close(area);
+  if (ret < 0) {
+    return ret;
+  }
+  hashedSize = offset;
+
+  return 0;
+}
+
+static int verifyImageHash() {
+  uint8_t hash[UPDATER_HASH_SIZE] = {0};
+  uint32_t startCycles = 0;
+
+  if (!manifestAvailable) {
+    return 0;
+  }
+
+  if (hashedSize != expectedImageSize) {
+    LOG_ERR("%d bytes written, the manifest expects %d bytes", hashedSize, expectedImageSize);
+    return -EIO;
+  }
+
+  startCycles = k_cycle_get_32();
+  mbedtls_sha256_finish(&imageHashContext, hash);
+  hashCycles += k_cycle_get_32() - startCycles;
+  if (memcmp(hash, expectedImageHash, sizeof(hash)) != 0) {
+    LOG_ERR("SHA-256 of slot1 doesn't match the manifest");
+    return -EBADMSG;
+  }
+  LOG_INF("SHA-256 verified while streaming, %lld ms of hashing and no flash read back",
+          k_cyc_to_ms_floor64(hashCycles));
+
+  return 0;
 }
 
 static bool confirmCurrentImage() {
@@ -169,6 +1110,7 @@ static bool confirmCurrentImage() {
     return false;
   }
 
+  runningVersion = header.h.v1.sem_ver;
   LOG_INF("Bootloader version: %d.x.y", header.mcuboot_version);
   LOG_INF("Application version: %d.%d.%d",
           header.h.v1.sem_ver.major,
@@ -187,30 +1129,105 @@ static bool confirmCurrentImage() {
     }
 
     LOG_INF("Marked image as confirmed");
-    ret = boot_erase_img_bank(FIXED_PARTITION_ID(slot1_partition));
-    if (ret) {
-      LOG_ERR("Failed to erase second slot: %d", ret);
-      return false;
-    }
   }
   return true;
 }
 
+static void startSlotEraser() {
+  int ret = 0;
+  download_progress_t progress = {0};
+
+  // Slot1 is only needed for a revert until this image is confirmed, from then on it is erased in
+  // the background, except for the part of an interrupted download that will be resumed
+  if (Storage::getInstance().read(STORAGE_ID_DOWNLOAD_PROGRESS, &progress, sizeof(progress)) !=
+      sizeof(progress)) {
+    progress.bytesWritten = 0;
+  }
+  ret = SlotEraser::getInstance().start(FIXED_PARTITION_ID(slot1_partition), progress.bytesWritten);
+  if (ret < 0) {
+    LOG_ERR("Failed to start erasing slot 1 (%d)", ret);
+  }
+}
+
+static void verifyReadbackAction(const event_message_t *message) {
+  int ret = 0;
+  int64_t startTime = 0;
+  int64_t elapsedTime = 0;
+  struct flash_img_check imageCheck = {0};
+
+  ARG_UNUSED(message);
+
+  if (!manifestAvailable || (hashedSize != expectedImageSize)) {
+    LOG_WRN("No image was downloaded against a manifest since boot, nothing to compare with");
+    return;
+  }
+
+  // The check done before streaming verification: slot1 is read back and hashed once complete
+  imageCheck.match = expectedImageHash;
+  imageCheck.clen = expectedImageSize;
+  startTime = k_uptime_get();
+  ret = flash_img_check(&flashContext, &imageCheck, FIXED_PARTITION_ID(slot1_partition));
+  elapsedTime = k_uptime_get() - startTime;
+
+  LOG_INF("Read-back check of %d bytes: %lld ms after the download (%s)",
+          expectedImageSize,
+          elapsedTime,
+          (ret == 0) ? "match" : "mismatch");
+  LOG_INF("Streamed check: %lld ms of hashing spread over the download, 0 bytes read back",
+          k_cyc_to_ms_floor64(hashCycles));
+}
+
 static int shellUpdateCommandHandler(const struct shell *shell, size_t argc, char **argv) {
-  event_t eventToPublish = {.id = EVENT_OTA_UPDATE_SHELL_CMD};
+  ota_event_t eventToPublish = {.id = EVENT_OTA_UPDATE_SHELL_CMD};
+
+  // Optional image URL, the default image is downloaded otherwise
+  if (argc > 1) {
+    if (strlen(argv[1]) >= sizeof(eventToPublish.url)) {
+      shell_error(shell, "URL is too long");
+      return -EINVAL;
+    }
+    strncpy(eventToPublish.url, argv[1], sizeof(eventToPublish.url) - 1);
+  }
+
+  shell_print(shell, "Starting OTA update...");
+  if (networkIsAvailable) {
+    publishEvent(&eventToPublish, EVENT_PUBLISH_TIMEOUT);
+  } else {
+    shell_error(shell, "Network is not available. Please ensure connectivity.");
+  }
+
+  return 0;
+}
+
+static int shellUpdateVerifyCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  ota_event_t eventToPublish = {.id = EVENT_OTA_VERIFY_SHELL_CMD};
 
   ARG_UNUSED(argc);
   ARG_UNUSED(argv);
 
-  shell_print(shell, "Starting OTA update...");
+  shell_print(shell, "Reading slot1 back...");
+  publishEvent(&eventToPublish, EVENT_PUBLISH_TIMEOUT);
+
+  return 0;
+}
+
+#ifdef CONFIG_UPDATER_PARALLEL_DOWNLOAD
+static int shellUpdateBenchCommandHandler(const struct shell *shell, size_t argc, char **argv) {
+  ota_event_t eventToPublish = {.id = EVENT_OTA_BENCHMARK_SHELL_CMD};
+
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  shell_print(shell, "Starting download benchmark...");
   if (networkIsAvailable) {
-    publishEvent(&eventToPublish, K_NO_WAIT);
+    publishEvent(&eventToPublish, EVENT_PUBLISH_TIMEOUT);
   } else {
     shell_error(shell, "Network is not available. Please ensure connectivity.");
   }
 
   return 0;
 }
+#endif // CONFIG_UPDATER_PARALLEL_DOWNLOAD
 
 static void drawProgressBar(uint32_t total, uint32_t progress) {
   uint32_t percent  = 0;
@@ -4,17 +4,24 @@
 // Lib C includes
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
 // Zephyr includes
 #include <zephyr/kernel.h>
+#include <zephyr/device.h>
 #include <zephyr/zbus/zbus.h>
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(main);
 
 // User C++ class headers
+#include "BootTracer.h"
 #include "EventManager.h"
 #include "Network.h"
 #include "Button.h"
+#ifdef CONFIG_TELEMETRY
+#include "Temperature.h"
+#include "Telemetry.h"
+#endif // CONFIG_TELEMETRY
 
 /*-----------------------------------------------------------------------------------------------*/
 /* Public functions                                                                              */
@@ -25,29 +32,53 @@ LOG_MODULE_REGISTER(main);
   * @retval None
   */
 int main(void) {
-  const struct gpio_dt_spec buttonGpio = GPIO_DT_SPEC_GET_OR(DT_ALIAS(sw0), gpios, {0});
-  Button button(&buttonGpio);
-  event_t eventToPublish = {.id = EVENT_BUTTON_PRESSED};
+  static const struct gpio_dt_spec buttonGpio = GPIO_DT_SPEC_GET_OR(DT_ALIAS(sw0), gpios, {0});
+  static Button button(&buttonGpio);
 
+  BootTracer::getInstance().mark(BootMilestone::MAIN_STARTED);
   Network::getInstance().onGotIP([](const char *ipAddress) {
-    event_t eventToPublish = {.id = EVENT_NETWORK_AVAILABLE};
+    network_event_t eventToPublish = {.id = EVENT_NETWORK_AVAILABLE};
 
     LOG_INF("Got IP address: %s", ipAddress);
-    publishEvent(&eventToPublish, K_NO_WAIT);
+    strncpy(eventToPublish.ipAddress, ipAddress, sizeof(eventToPublish.ipAddress) - 1);
+    publishEvent(&eventToPublish, EVENT_PUBLISH_TIMEOUT);
   });
+  Network::getInstance().onLost([]() {
+    network_event_t eventToPublish = {.id = EVENT_NETWORK_UNAVAILABLE};
+
+    publishEvent(&eventToPublish, EVENT_PUBLISH_TIMEOUT);
+  });
+
+#ifdef CONFIG_TELEMETRY
+  // Die temperature is sampled in the background, telemetry records hundredths of a degree Celsius
+  static Temperature temperature(DEVICE_DT_GET(DT_NODELABEL(die_temp)));
+  if (temperature.start() < 0) {
+    LOG_ERR("Failed to start sampling the die temperature");
+  }
+  Telemetry::getInstance().addSensor(TELEMETRY_SENSOR_DIE_TEMPERATURE, [](int16_t *value) {
+    temperature_reading_t reading = {0};
+    int ret = temperature.read(&reading);
+
+    if (ret < 0) {
+      return ret;
+    }
+    *value = (int16_t)(reading.milliCelsius / 10);
+    return 0;
+  });
+  Telemetry::getInstance().start();
+#endif // CONFIG_TELEMETRY
 
   LOG_INF("Waiting for network connection...");
   Network::getInstance().start();
 
-  while (true) {
-    if (button.isPressed()) {
-      LOG_INF("Button is pressed");
-      publishEvent(&eventToPublish, K_NO_WAIT);
-    }
-    k_msleep(300);
+  // The button publishes its events from its interrupt
+  if (button.enableEvents() < 0) {
+    LOG_ERR("Failed to enable button events");
   }
 
-  return EXIT_FAILURE;
+  // Everything from here on is driven by interrupts, work items and events: the main thread is
+  // done and the idle thread can keep the SoC in low-power states until the next event
+  return EXIT_SUCCESS;
 }
 
 /**